@@ -0,0 +1,378 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Microbenchmarks for the components of the kernels: the mix128to64() function, the ADD/XOR table lookups, the MIX
+ * permutation, get_byte() and the final function, as well as a complete scalar round and the selected update kernel.
+ * The library source is included into this program directly, so that its internal functions can be called; just like
+ * with bench_tables, it is built once for each table layout (see MHASH384_FUSED_TABLES). For each component, cycles,
+ * instructions, L1D read misses and branch misses are read via perf_event_open(), and reported per unit of work.
+ */
+
+#include "mhash384.cpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if MHASH384_FUSED_TABLES
+#define LAYOUT_NAME "fused"
+#else
+#define LAYOUT_NAME "separate"
+#endif
+
+/* Parameters */
+static const size_t BUFFER_SIZE = 16384U;
+static const size_t FINAL_CALLS = 256U;
+static const size_t REPETITIONS = 256U;
+
+/* Hardware counters, read as one group */
+typedef enum
+{
+	COUNTER_CYCLES       = 0,
+	COUNTER_INSTRUCTIONS = 1,
+	COUNTER_L1D_MISSES   = 2,
+	COUNTER_BRANCH_MISS  = 3,
+	COUNTER_MAX          = 4
+}
+counter_id_t;
+
+typedef struct
+{
+	int fd[COUNTER_MAX];
+	uint64_t value[COUNTER_MAX];
+}
+counters_t;
+
+/* Microbenchmark; "run" processes the given number of units, and returns a value that depends on all of them */
+typedef struct
+{
+	const char *name;
+	const char *unit;
+	size_t units;
+	ui64_t (*run)(const byte_t *const data, const size_t units);
+}
+micro_t;
+
+/* ======================================================================== */
+/* PERFORMANCE COUNTERS                                                     */
+/* ======================================================================== */
+
+#ifdef __linux__
+
+static int open_counter(const uint32_t type, const uint64_t config, const int group_fd)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = (group_fd < 0) ? 1U : 0U;
+	attr.exclude_kernel = 1U;
+	attr.exclude_hv = 1U;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void counters_close(counters_t *const counters)
+{
+	for(size_t i = COUNTER_MAX; i > 0U; --i)
+	{
+		if(counters->fd[i - 1U] >= 0)
+		{
+			close(counters->fd[i - 1U]);
+			counters->fd[i - 1U] = -1;
+		}
+	}
+}
+
+static void counters_open(counters_t *const counters)
+{
+	memset(counters->value, 0, sizeof(counters->value));
+	counters->fd[COUNTER_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+	counters->fd[COUNTER_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, counters->fd[COUNTER_CYCLES]);
+	counters->fd[COUNTER_L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), counters->fd[COUNTER_CYCLES]);
+	counters->fd[COUNTER_BRANCH_MISS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, counters->fd[COUNTER_CYCLES]);
+	for(size_t i = 0U; i < COUNTER_MAX; ++i)
+	{
+		if(counters->fd[i] < 0)
+		{
+			counters_close(counters); /*all or nothing*/
+			return;
+		}
+	}
+}
+
+static inline void counters_start(const counters_t *const counters)
+{
+	if(counters->fd[COUNTER_CYCLES] >= 0)
+	{
+		ioctl(counters->fd[COUNTER_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(counters->fd[COUNTER_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+}
+
+static inline void counters_stop(counters_t *const counters)
+{
+	uint64_t values[1U + COUNTER_MAX];
+	if(counters->fd[COUNTER_CYCLES] >= 0)
+	{
+		ioctl(counters->fd[COUNTER_CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		if((read(counters->fd[COUNTER_CYCLES], values, sizeof(values)) == sizeof(values)) && (values[0U] == COUNTER_MAX))
+		{
+			for(size_t i = 0U; i < COUNTER_MAX; ++i)
+			{
+				counters->value[i] += values[1U + i];
+			}
+		}
+	}
+}
+
+#else
+
+static void counters_open(counters_t *const counters)
+{
+	for(size_t i = 0U; i < COUNTER_MAX; ++i)
+	{
+		counters->fd[i] = -1;
+		counters->value[i] = 0U;
+	}
+}
+
+static void counters_close(counters_t *const counters) { }
+static inline void counters_start(const counters_t *const counters) { }
+static inline void counters_stop(counters_t *const counters) { }
+
+#endif //__linux__
+
+/* ======================================================================== */
+/* MICROBENCHMARKS                                                          */
+/* ======================================================================== */
+
+/*
+ * Six mix128to64() calls per input byte, one per state word, with the same dependency chains as in a round
+ */
+static ui64_t micro_mix128to64(const byte_t *const data, const size_t units)
+{
+	ui64_t h[MHASH384_WORDS];
+	memcpy(h, MHASH384_INI, MHASH384_SIZE);
+	for(size_t i = 0U; i < units; ++i)
+	{
+		for(size_t j = 0U; j < MHASH384_WORDS; ++j)
+		{
+			h[j] = mix128to64(h[j] + data[i], h[j]);
+		}
+	}
+	return h[0U] ^ h[1U] ^ h[2U] ^ h[3U] ^ h[4U] ^ h[5U];
+}
+
+/*
+ * One row of the ADD table and one row of the XOR table per input byte
+ */
+static ui64_t micro_tables(const byte_t *const data, const size_t units)
+{
+	ui64_t acc[MHASH384_WORDS] = { 0U, 0U, 0U, 0U, 0U, 0U };
+	for(size_t i = 0U; i < units; ++i)
+	{
+		const ui64_t *const p_add = TABLE_ADD(data[i]);
+		const ui64_t *const p_xor = TABLE_XOR(data[i]);
+		for(size_t j = 0U; j < MHASH384_WORDS; ++j)
+		{
+			acc[j] += p_add[j] ^ p_xor[j];
+		}
+	}
+	return acc[0U] ^ acc[1U] ^ acc[2U] ^ acc[3U] ^ acc[4U] ^ acc[5U];
+}
+
+/*
+ * One row of the MIX table per input byte, applied to the state words
+ */
+static ui64_t micro_mix_permutation(const byte_t *const data, const size_t units)
+{
+	ui64_t h[MHASH384_WORDS], temp[MHASH384_WORDS];
+	byte_t rnd = 0U;
+	memcpy(h, MHASH384_INI, MHASH384_SIZE);
+	for(size_t i = 0U; i < units; ++i)
+	{
+		const byte_t *const p_mix = MHASH384_MIX[rnd++];
+		for(size_t j = 0U; j < MHASH384_WORDS; ++j)
+		{
+			temp[j] = h[p_mix[j]] + data[i];
+		}
+		memcpy(h, temp, MHASH384_SIZE);
+	}
+	return h[0U] ^ h[1U] ^ h[2U] ^ h[3U] ^ h[4U] ^ h[5U];
+}
+
+/*
+ * One output byte extracted with get_byte() per unit, in the order of the FIN table
+ */
+static ui64_t micro_get_byte(const byte_t *const data, const size_t units)
+{
+	ui64_t h[MHASH384_WORDS], acc = 0U;
+	memcpy(h, MHASH384_INI, MHASH384_SIZE);
+	for(size_t i = 0U; i < units; ++i)
+	{
+		acc += get_byte(h, MHASH384_FIN[i % MHASH384_SIZE]);
+		h[i % MHASH384_WORDS] ^= data[i] + acc;
+	}
+	return acc;
+}
+
+/*
+ * One complete round of the scalar kernel per input byte, without the unrolling of update_blocks()
+ */
+static ui64_t micro_round(const byte_t *const data, const size_t units)
+{
+	mhash384_t ctx;
+	mhash384_init(&ctx);
+	for(size_t i = 0U; i < units; ++i)
+	{
+		round_kernel(&ctx, data[i]);
+	}
+	return ctx.hash[0U];
+}
+
+/*
+ * The update function of the selected kernel
+ */
+static ui64_t micro_update(const byte_t *const data, const size_t units)
+{
+	mhash384_t ctx;
+	mhash384_init(&ctx);
+	get_kernel()->update(&ctx, data, units);
+	return ctx.hash[0U];
+}
+
+/*
+ * The final function of the selected kernel, one call per unit
+ */
+static ui64_t micro_final(const byte_t *const data, const size_t units)
+{
+	mhash384_t ctx, prepared;
+	byte_t digest[MHASH384_SIZE];
+	ui64_t acc = 0U;
+	mhash384_init(&prepared);
+	get_kernel()->update(&prepared, data, 64U);
+	for(size_t i = 0U; i < units; ++i)
+	{
+		memcpy(&ctx, &prepared, sizeof(mhash384_t));
+		ctx.hash[0U] ^= acc;
+		get_kernel()->final(&ctx, digest);
+		acc += digest[0U];
+	}
+	return acc;
+}
+
+static const micro_t MICROBENCHMARKS[] =
+{
+	{ "mix128to64 (x6)", "byte", BUFFER_SIZE, micro_mix128to64      },
+	{ "table lookups",   "byte", BUFFER_SIZE, micro_tables          },
+	{ "MIX permutation", "byte", BUFFER_SIZE, micro_mix_permutation },
+	{ "get_byte",        "byte", BUFFER_SIZE, micro_get_byte        },
+	{ "round (scalar)",  "byte", BUFFER_SIZE, micro_round           },
+	{ "update (kernel)", "byte", BUFFER_SIZE, micro_update          },
+	{ "final (kernel)",  "call", FINAL_CALLS, micro_final           },
+	{ NULL, NULL, 0U, NULL }
+};
+
+/*
+ * Print the counter value per unit, or "n/a"
+ */
+static void print_counter(const counters_t *const counters, const counter_id_t id, const uint64_t units)
+{
+	if(counters->fd[COUNTER_CYCLES] >= 0)
+	{
+		printf(" %12.3f", counters->value[id] / (double)units);
+	}
+	else
+	{
+		printf(" %12s", "n/a");
+	}
+}
+
+/* ======================================================================== */
+/* MAIN                                                                     */
+/* ======================================================================== */
+
+int main(void)
+{
+	static volatile ui64_t sink;
+	byte_t *const data = (byte_t*)malloc(BUFFER_SIZE);
+	if(!data)
+	{
+		fputs("Error: Memory allocation has failed!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	ui64_t state = 0x9E3779B97F4A7C15ULL;
+	for(size_t i = 0U; i < BUFFER_SIZE; ++i)
+	{
+		state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+		data[i] = (byte_t)state;
+	}
+
+	printf("Table layout: %s, kernel: %s\n\n", LAYOUT_NAME, get_kernel()->name);
+	printf("%-16s %4s %10s %12s %12s %12s %12s\n", "Component", "Unit", "ns/unit", "cycles/unit", "IPC", "L1D-miss/u", "br-miss/u");
+
+	for(size_t m = 0U; MICROBENCHMARKS[m].name; ++m)
+	{
+		const micro_t *const micro = &MICROBENCHMARKS[m];
+		counters_t counters;
+		counters_open(&counters);
+		sink = micro->run(data, micro->units); /*warm-up*/
+
+		std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::duration::zero();
+		for(size_t r = 0U; r < REPETITIONS; ++r)
+		{
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			counters_start(&counters);
+			sink = micro->run(data, micro->units);
+			counters_stop(&counters);
+			elapsed += std::chrono::steady_clock::now() - start;
+		}
+
+		const uint64_t units = (uint64_t)micro->units * REPETITIONS;
+		printf("%-16s %4s %10.3f", micro->name, micro->unit, std::chrono::duration<double, std::nano>(elapsed).count() / units);
+		print_counter(&counters, COUNTER_CYCLES, units);
+		if((counters.fd[COUNTER_CYCLES] >= 0) && (counters.value[COUNTER_CYCLES] > 0U))
+		{
+			printf(" %12.2f", counters.value[COUNTER_INSTRUCTIONS] / (double)counters.value[COUNTER_CYCLES]);
+		}
+		else
+		{
+			printf(" %12s", "n/a");
+		}
+		print_counter(&counters, COUNTER_L1D_MISSES, units);
+		print_counter(&counters, COUNTER_BRANCH_MISS, units);
+		putchar('\n');
+		counters_close(&counters);
+	}
+
+	(void)sink; /*the results are only stored, so that the calls can not be optimized away*/
+	free(data);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Compares the L1 data cache behavior of the "separate" and the "fused" table layout (see MHASH384_FUSED_TABLES).
+ * The library source is linked into this program directly, so that both layouts can be built side by side. The input
+ * is hashed in small chunks; optionally, a buffer that simulates the working set of the application is touched after
+ * each chunk, so that the tables have to compete for the L1 cache. Only the hashing itself is timed and counted.
+ */
+
+#include "mhash384.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if MHASH384_FUSED_TABLES
+#define LAYOUT_NAME "fused"
+#else
+#define LAYOUT_NAME "separate"
+#endif
+
+/* Parameters */
+static const size_t CHUNK_SIZE = 4096U;
+static const size_t WORKING_SET[] = { 0U, 16384U, 32768U };
+static const size_t CACHE_LINE = 64U;
+
+/* L1D counters */
+typedef struct
+{
+	int fd_loads, fd_misses;
+	uint64_t loads, misses;
+}
+counters_t;
+
+/* ======================================================================== */
+/* PERFORMANCE COUNTERS                                                     */
+/* ======================================================================== */
+
+#ifdef __linux__
+
+static int open_counter(const uint64_t result, const int group_fd)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+	attr.disabled = (group_fd < 0) ? 1U : 0U;
+	attr.exclude_kernel = 1U;
+	attr.exclude_hv = 1U;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void counters_open(counters_t *const counters)
+{
+	counters->loads = counters->misses = 0U;
+	counters->fd_misses = -1;
+	if((counters->fd_loads = open_counter(PERF_COUNT_HW_CACHE_RESULT_ACCESS, -1)) >= 0)
+	{
+		if((counters->fd_misses = open_counter(PERF_COUNT_HW_CACHE_RESULT_MISS, counters->fd_loads)) < 0)
+		{
+			close(counters->fd_loads);
+			counters->fd_loads = -1;
+		}
+	}
+}
+
+static void counters_close(counters_t *const counters)
+{
+	if(counters->fd_loads >= 0)
+	{
+		close(counters->fd_misses);
+		close(counters->fd_loads);
+	}
+}
+
+static inline void counters_start(const counters_t *const counters)
+{
+	if(counters->fd_loads >= 0)
+	{
+		ioctl(counters->fd_loads, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+}
+
+static inline void counters_stop(counters_t *const counters)
+{
+	uint64_t value;
+	if(counters->fd_loads >= 0)
+	{
+		ioctl(counters->fd_loads, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		if(read(counters->fd_loads, &value, sizeof(value)) == sizeof(value))
+		{
+			counters->loads += value;
+		}
+		if(read(counters->fd_misses, &value, sizeof(value)) == sizeof(value))
+		{
+			counters->misses += value;
+		}
+		ioctl(counters->fd_loads, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	}
+}
+
+#else
+
+static void counters_open(counters_t *const counters)
+{
+	counters->fd_loads = counters->fd_misses = -1;
+	counters->loads = counters->misses = 0U;
+}
+
+static void counters_close(counters_t *const counters) { }
+static inline void counters_start(const counters_t *const counters) { }
+static inline void counters_stop(counters_t *const counters) { }
+
+#endif //__linux__
+
+/* ======================================================================== */
+/* BENCHMARK                                                                */
+/* ======================================================================== */
+
+/*
+ * Read the whole file into memory
+ */
+static uint8_t *load_file(const char *const file_name, size_t *const size)
+{
+	uint8_t *buffer = NULL;
+	long length;
+	FILE *const file = fopen(file_name, "rb");
+	if(!file)
+	{
+		return NULL;
+	}
+	if((!fseek(file, 0L, SEEK_END)) && ((length = ftell(file)) > 0L) && (!fseek(file, 0L, SEEK_SET)))
+	{
+		if((buffer = (uint8_t*)malloc((size_t)length)))
+		{
+			if(fread(buffer, 1U, (size_t)length, file) != (size_t)length)
+			{
+				free(buffer);
+				buffer = NULL;
+			}
+		}
+	}
+	fclose(file);
+	*size = buffer ? (size_t)length : 0U;
+	return buffer;
+}
+
+/*
+ * Hash the input chunk by chunk, touching the simulated working set in between
+ */
+static double run_benchmark(const uint8_t *const data, const size_t size, volatile uint8_t *const working_set, const size_t working_set_size, counters_t *const counters)
+{
+	mhash384_t ctx;
+	uint8_t digest[MHASH384_SIZE];
+	std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::duration::zero();
+	size_t pos, i;
+	mhash384_init(&ctx);
+	for(pos = 0U; pos < size; pos += CHUNK_SIZE)
+	{
+		const size_t len = ((size - pos) < CHUNK_SIZE) ? (size - pos) : CHUNK_SIZE;
+		for(i = 0U; i < working_set_size; i += CACHE_LINE)
+		{
+			working_set[i]++;
+		}
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		counters_start(counters);
+		mhash384_update(&ctx, data + pos, len);
+		counters_stop(counters);
+		elapsed += std::chrono::steady_clock::now() - start;
+	}
+	mhash384_final(&ctx, digest);
+	return std::chrono::duration<double>(elapsed).count();
+}
+
+/*
+ * Print the counter value per KiB of input, or "n/a"
+ */
+static void print_counter(const counters_t *const counters, const uint64_t value, const size_t size)
+{
+	if(counters->fd_loads >= 0)
+	{
+		printf(" %12.1f", value / (size / 1024.0));
+	}
+	else
+	{
+		printf(" %12s", "n/a");
+	}
+}
+
+/* ======================================================================== */
+/* MAIN                                                                     */
+/* ======================================================================== */
+
+int main(int argc, char *argv[])
+{
+	size_t w, size;
+	int i, result = EXIT_SUCCESS;
+	uint8_t *working_set;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <file_1> [<file_2> ... <file_n>]\n", argv[0U]);
+		return EXIT_FAILURE;
+	}
+
+	if(!(working_set = (uint8_t*)calloc(WORKING_SET[sizeof(WORKING_SET) / sizeof(WORKING_SET[0U]) - 1U], 1U)))
+	{
+		fputs("Error: Memory allocation has failed!\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	printf("Table layout: %s, kernel: %s\n\n", LAYOUT_NAME, mhash384_kernel());
+	printf("%-28s %9s %10s %12s %12s %10s\n", "File", "WorkSet", "MB/s", "L1D-ld/KiB", "L1D-miss/KiB", "Miss-rate");
+
+	for(i = 1; i < argc; ++i)
+	{
+		const char *const file_name = argv[i];
+		uint8_t *const data = load_file(file_name, &size);
+		if(!data)
+		{
+			fprintf(stderr, "Error: Failed to read file \"%s\"!\n", file_name);
+			result = EXIT_FAILURE;
+			continue;
+		}
+		for(w = 0U; w < sizeof(WORKING_SET) / sizeof(WORKING_SET[0U]); ++w)
+		{
+			counters_t counters;
+			const char *const base_name = strrchr(file_name, '/') ? (strrchr(file_name, '/') + 1U) : file_name;
+			counters_open(&counters);
+			const double elapsed = run_benchmark(data, size, working_set, WORKING_SET[w], &counters);
+			printf("%-28s %5u KiB %10.2f", base_name, (unsigned)(WORKING_SET[w] / 1024U), (size / 1000000.0) / elapsed);
+			print_counter(&counters, counters.loads, size);
+			print_counter(&counters, counters.misses, size);
+			if((counters.fd_loads >= 0) && (counters.loads > 0U))
+			{
+				printf(" %9.2f%%\n", 100.0 * counters.misses / counters.loads);
+			}
+			else
+			{
+				printf(" %10s\n", "n/a");
+			}
+			counters_close(&counters);
+		}
+		free(data);
+	}
+
+	free(working_set);
+	return result;
+}
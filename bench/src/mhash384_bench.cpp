@@ -0,0 +1,452 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Measures the throughput of the library, as it is linked into applications: mhash384_compute() over message sizes
+ * from 0 bytes up to 1 GiB, mhash384_update() at various chunk sizes, and mhash384_final() alone; each one with warm
+ * and with cold caches, and on 1 to N threads concurrently. The results are written in JSON format, so that they can
+ * be compared between library versions and kernels (see the MHASH384_KERNEL environment variable).
+ */
+
+#include "mhash384.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+/* Parameters */
+static const uint64_t MESSAGE_SIZE[] = { 0U, 1U, 64U, 1024U, 4096U, 65536U, 1U << 20, 16U << 20, 256U << 20, 1024U << 20 };
+static const size_t CHUNK_SIZE[] = { 1U, 64U, 4096U, 65536U };
+static const uint64_t MAX_UPDATE_CALLS = 1U << 24;
+static const size_t SAMPLE_BYTES = 65536U;
+static const size_t FINAL_BATCH = 1024U;
+static const size_t EVICT_SIZE = 64U << 20;
+static const uint64_t MAX_COLD_SAMPLES = 32U;
+static const size_t CACHE_LINE = 64U;
+
+/* Operations */
+typedef enum
+{
+	OP_COMPUTE = 0,
+	OP_UPDATE  = 1,
+	OP_FINAL   = 2
+}
+op_t;
+
+static const char *const OP_NAME[] = { "compute", "update", "final" };
+
+/* Benchmark case */
+typedef struct
+{
+	op_t op;
+	uint64_t size;
+	size_t chunk;
+	bool cold;
+	uint32_t threads;
+}
+bench_case_t;
+
+/* Per-thread result */
+typedef struct
+{
+	uint64_t ops, bytes, cycles;
+	double seconds;
+}
+thread_result_t;
+
+/* Source of the cycle counts */
+typedef enum
+{
+	CYCLES_NONE = 0,
+	CYCLES_PERF = 1,
+	CYCLES_TSC  = 2
+}
+cycle_source_t;
+
+static const char *const CYCLE_SOURCE_NAME[] = { "none", "perf", "tsc" };
+
+/* ======================================================================== */
+/* CYCLE COUNTER                                                            */
+/* ======================================================================== */
+
+/*
+ * Open the core cycle counter of the calling thread; returns -1, if the counter is not available
+ */
+static int cycles_open(void)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1U;
+	attr.exclude_hv = 1U;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static void cycles_close(const int fd)
+{
+#ifdef __linux__
+	if(fd >= 0)
+	{
+		close(fd);
+	}
+#endif
+}
+
+/*
+ * Read the core cycle counter, or the time-stamp counter as a fallback
+ */
+static inline uint64_t cycles_read(const int fd, const cycle_source_t source)
+{
+	uint64_t value = 0U;
+#ifdef __linux__
+	if(source == CYCLES_PERF)
+	{
+		return (read(fd, &value, sizeof(value)) == sizeof(value)) ? value : 0U;
+	}
+#endif
+#ifdef HAVE_TSC
+	if(source == CYCLES_TSC)
+	{
+		return __rdtsc();
+	}
+#endif
+	return value;
+}
+
+static cycle_source_t cycles_detect(void)
+{
+	const int fd = cycles_open();
+	if(fd >= 0)
+	{
+		cycles_close(fd);
+		return CYCLES_PERF;
+	}
+#ifdef HAVE_TSC
+	return CYCLES_TSC;
+#else
+	return CYCLES_NONE;
+#endif
+}
+
+/* ======================================================================== */
+/* BENCHMARK                                                                */
+/* ======================================================================== */
+
+/*
+ * Evict the message (and the tables) from the caches, by touching a buffer larger than the last-level cache
+ */
+static void evict_caches(volatile uint8_t *const buffer)
+{
+	for(size_t i = 0U; i < EVICT_SIZE; i += CACHE_LINE)
+	{
+		buffer[i]++;
+	}
+}
+
+/*
+ * Run a single operation on the message
+ */
+static inline void run_op(const bench_case_t &bench_case, const uint8_t *const data, const mhash384_t &prepared, uint8_t *const digest)
+{
+	mhash384_t ctx;
+	switch(bench_case.op)
+	{
+	case OP_COMPUTE:
+		mhash384_compute(digest, data, (size_t)bench_case.size);
+		break;
+	case OP_UPDATE:
+		mhash384_init(&ctx);
+		for(uint64_t pos = 0U; pos < bench_case.size; pos += bench_case.chunk)
+		{
+			const size_t len = ((bench_case.size - pos) < bench_case.chunk) ? (size_t)(bench_case.size - pos) : bench_case.chunk;
+			mhash384_update(&ctx, data + pos, len);
+		}
+		mhash384_final(&ctx, digest);
+		break;
+	case OP_FINAL:
+		memcpy(&ctx, &prepared, sizeof(mhash384_t));
+		mhash384_final(&ctx, digest);
+		break;
+	}
+}
+
+/*
+ * Benchmark thread; samples are taken until the minimum time has elapsed. With cold caches, each sample is a single
+ * operation, preceded by the eviction (which is not timed), and at most MAX_COLD_SAMPLES are taken; otherwise, each
+ * sample consists of enough operations to hash at least SAMPLE_BYTES, after one untimed warm-up operation
+ */
+static void bench_thread(const bench_case_t &bench_case, const uint8_t *const data, const double min_time, const cycle_source_t source, std::atomic<uint32_t> &ready, thread_result_t &result)
+{
+	uint8_t digest[MHASH384_SIZE];
+	mhash384_t prepared;
+	mhash384_init(&prepared);
+	mhash384_update(&prepared, data, 64U);
+
+	std::vector<uint8_t> evict_buffer(bench_case.cold ? EVICT_SIZE : 0U);
+	const int fd = (source == CYCLES_PERF) ? cycles_open() : -1;
+	const cycle_source_t thread_source = ((source == CYCLES_PERF) && (fd < 0)) ? CYCLES_NONE : source;
+	const uint64_t batch = bench_case.cold ? 1U : ((bench_case.op == OP_FINAL) ? FINAL_BATCH : ((bench_case.size < SAMPLE_BYTES) ? SAMPLE_BYTES / (bench_case.size ? bench_case.size : 1U) : 1U));
+
+	memset(&result, 0, sizeof(thread_result_t));
+	if(!bench_case.cold)
+	{
+		run_op(bench_case, data, prepared, digest);
+	}
+
+	--ready;
+	while(ready.load())
+	{
+		std::this_thread::yield(); /*start all threads at the same time*/
+	}
+
+	std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::duration::zero();
+	do
+	{
+		if(bench_case.cold)
+		{
+			evict_caches(evict_buffer.data());
+		}
+		const uint64_t cycles_start = cycles_read(fd, thread_source);
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(uint64_t i = 0U; i < batch; ++i)
+		{
+			run_op(bench_case, data, prepared, digest);
+		}
+		elapsed += std::chrono::steady_clock::now() - start;
+		result.cycles += cycles_read(fd, thread_source) - cycles_start;
+		result.ops += batch;
+	}
+	while((std::chrono::duration<double>(elapsed).count() < min_time) && ((!bench_case.cold) || (result.ops < MAX_COLD_SAMPLES)));
+
+	result.seconds = std::chrono::duration<double>(elapsed).count();
+	result.bytes = result.ops * ((bench_case.op == OP_FINAL) ? 0U : bench_case.size);
+	if(thread_source == CYCLES_NONE)
+	{
+		result.cycles = 0U;
+	}
+	cycles_close(fd);
+}
+
+/*
+ * Run the benchmark case on the requested number of threads, and print the result as JSON object
+ */
+static void run_case(FILE *const output, const bench_case_t &bench_case, const uint8_t *const data, const double min_time, const cycle_source_t source, const bool first)
+{
+	std::vector<thread_result_t> results(bench_case.threads);
+	std::vector<std::thread> threads;
+	std::atomic<uint32_t> ready(bench_case.threads);
+	for(uint32_t i = 0U; i < bench_case.threads; ++i)
+	{
+		threads.emplace_back(bench_thread, std::cref(bench_case), data, min_time, source, std::ref(ready), std::ref(results[i]));
+	}
+
+	uint64_t ops = 0U, bytes = 0U, cycles = 0U;
+	double ops_per_sec = 0.0, bytes_per_sec = 0.0;
+	for(uint32_t i = 0U; i < bench_case.threads; ++i)
+	{
+		threads[i].join();
+		ops += results[i].ops;
+		bytes += results[i].bytes;
+		cycles += results[i].cycles;
+		ops_per_sec += results[i].ops / results[i].seconds;
+		bytes_per_sec += results[i].bytes / results[i].seconds;
+	}
+
+	fprintf(output, "%s\n    { \"op\": \"%s\", \"size\": %" PRIu64 ", \"chunk\": %u, \"cache\": \"%s\", \"threads\": %u, \"ops\": %" PRIu64 ", \"ops_per_sec\": %.1f, \"bytes_per_sec\": %.1f, ",
+		first ? "" : ",", OP_NAME[bench_case.op], bench_case.size, (unsigned)bench_case.chunk, bench_case.cold ? "cold" : "warm", bench_case.threads, ops, ops_per_sec, bytes_per_sec);
+	if(cycles && bytes)
+	{
+		fprintf(output, "\"cycles_per_op\": %.1f, \"cycles_per_byte\": %.3f }", cycles / (double)ops, cycles / (double)bytes);
+	}
+	else if(cycles)
+	{
+		fprintf(output, "\"cycles_per_op\": %.1f, \"cycles_per_byte\": null }", cycles / (double)ops);
+	}
+	else
+	{
+		fputs("\"cycles_per_op\": null, \"cycles_per_byte\": null }", output);
+	}
+	fflush(output);
+
+	fprintf(stderr, "%-8s size=%-10" PRIu64 " chunk=%-6u %s threads=%-3u %10.2f MB/s\n", OP_NAME[bench_case.op], bench_case.size, (unsigned)bench_case.chunk, bench_case.cold ? "cold" : "warm", bench_case.threads, bytes_per_sec / 1000000.0);
+}
+
+/* ======================================================================== */
+/* MAIN                                                                     */
+/* ======================================================================== */
+
+/*
+ * Parse a size, with an optional "K", "M" or "G" suffix
+ */
+static bool parse_size(const char *const str, uint64_t *const value)
+{
+	char *end_ptr = NULL;
+	const unsigned long long number = strtoull(str, &end_ptr, 10);
+	if((!end_ptr) || (end_ptr == str))
+	{
+		return false;
+	}
+	switch(*end_ptr)
+	{
+		case '\0':            *value = number;       return true;
+		case 'K': case 'k':   *value = number << 10; return !end_ptr[1U];
+		case 'M': case 'm':   *value = number << 20; return !end_ptr[1U];
+		case 'G': case 'g':   *value = number << 30; return !end_ptr[1U];
+	}
+	return false;
+}
+
+static void print_usage(const char *const argv0)
+{
+	fprintf(stderr, "Usage: %s [--max-size SIZE] [--threads N] [--min-time SEC] [--output FILE]\n\n", argv0);
+	fputs("   --max-size SIZE  Largest message size, with optional K/M/G suffix (default: 1G)\n", stderr);
+	fputs("   --threads N      Largest number of threads (default: number of CPUs)\n", stderr);
+	fputs("   --min-time SEC   Minimum measurement time per benchmark and thread (default: 0.2)\n", stderr);
+	fputs("   --output FILE    Write the JSON results to FILE (default: stdout)\n", stderr);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t max_size = 1024U << 20;
+	uint32_t max_threads = std::thread::hardware_concurrency();
+	double min_time = 0.2;
+	const char *output_file = NULL;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		if((!strcmp(argv[i], "--max-size")) && (i + 1 < argc) && parse_size(argv[i + 1], &max_size))
+		{
+			++i;
+		}
+		else if((!strcmp(argv[i], "--threads")) && (i + 1 < argc) && (atoi(argv[i + 1]) > 0))
+		{
+			max_threads = (uint32_t)atoi(argv[++i]);
+		}
+		else if((!strcmp(argv[i], "--min-time")) && (i + 1 < argc) && (atof(argv[i + 1]) > 0.0))
+		{
+			min_time = atof(argv[++i]);
+		}
+		else if((!strcmp(argv[i], "--output")) && (i + 1 < argc))
+		{
+			output_file = argv[++i];
+		}
+		else
+		{
+			print_usage(argv[0U]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(max_threads < 1U)
+	{
+		max_threads = 1U;
+	}
+
+	/* Allocate the message; it is shared by all threads, because it is only read */
+	const size_t buffer_size = (size_t)((max_size > 64U) ? max_size : 64U);
+	uint8_t *const data = (uint8_t*)malloc(buffer_size);
+	if(!data)
+	{
+		fputs("Error: Memory allocation has failed!\n", stderr);
+		return EXIT_FAILURE;
+	}
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+	for(size_t i = 0U; i < buffer_size; ++i)
+	{
+		state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+		data[i] = (uint8_t)state;
+	}
+
+	FILE *const output = output_file ? fopen(output_file, "w") : stdout;
+	if(!output)
+	{
+		fprintf(stderr, "Error: Failed to open output file \"%s\"!\n", output_file);
+		free(data);
+		return EXIT_FAILURE;
+	}
+
+	uint16_t major, minor, patch;
+	mhash384_version(&major, &minor, &patch);
+	const cycle_source_t source = cycles_detect();
+	fprintf(output, "{\n  \"version\": \"%u.%u.%u\",\n  \"kernel\": \"%s\",\n  \"cpus\": %u,\n  \"cycle_source\": \"%s\",\n  \"min_time\": %.3f,\n  \"results\": [",
+		major, minor, patch, mhash384_kernel(), std::thread::hardware_concurrency(), CYCLE_SOURCE_NAME[source], min_time);
+
+	/* Thread counts: powers of two, plus the maximum */
+	std::vector<uint32_t> thread_counts;
+	for(uint32_t threads = 1U; threads < max_threads; threads <<= 1)
+	{
+		thread_counts.push_back(threads);
+	}
+	thread_counts.push_back(max_threads);
+
+	bool first = true;
+	for(std::vector<uint32_t>::const_iterator threads = thread_counts.begin(); threads != thread_counts.end(); ++threads)
+	{
+		for(int cold = 0; cold < 2; ++cold)
+		{
+			const bench_case_t final_case = { OP_FINAL, 0U, 0U, cold != 0, *threads };
+			run_case(output, final_case, data, min_time, source, first);
+			first = false;
+			for(size_t s = 0U; (s < sizeof(MESSAGE_SIZE) / sizeof(MESSAGE_SIZE[0U])) && (MESSAGE_SIZE[s] <= max_size); ++s)
+			{
+				const bench_case_t compute_case = { OP_COMPUTE, MESSAGE_SIZE[s], 0U, cold != 0, *threads };
+				run_case(output, compute_case, data, min_time, source, false);
+				for(size_t c = 0U; c < sizeof(CHUNK_SIZE) / sizeof(CHUNK_SIZE[0U]); ++c)
+				{
+					if((CHUNK_SIZE[c] < MESSAGE_SIZE[s]) && (MESSAGE_SIZE[s] / CHUNK_SIZE[c] <= MAX_UPDATE_CALLS))
+					{
+						const bench_case_t update_case = { OP_UPDATE, MESSAGE_SIZE[s], CHUNK_SIZE[c], cold != 0, *threads };
+						run_case(output, update_case, data, min_time, source, false);
+					}
+				}
+			}
+		}
+	}
+
+	fputs("\n  ]\n}\n", output);
+	if(output_file)
+	{
+		fclose(output);
+	}
+
+	free(data);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "check.h"
+#include "utils.h"
+
+#include <errno.h>
+
+/* Win32 stuff */
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#endif
+
+/*
+ * Read the next input line, of arbitrary length; the line break is removed
+ */
+static bool read_line(FILE *const input, std::string &line)
+{
+	char buffer[1024U];
+	line.clear();
+	while(fgets(buffer, sizeof(buffer), input))
+	{
+		line.append(buffer);
+		if((!line.empty()) && (line[line.length() - 1U] == '\n'))
+		{
+			break;
+		}
+	}
+	while((!line.empty()) && ((line[line.length() - 1U] == '\n') || (line[line.length() - 1U] == '\r')))
+	{
+		line.erase(line.length() - 1U);
+	}
+	return (!line.empty()) || (!feof(input));
+}
+
+/*
+ * Convert the file name from UTF-8 to the native character type
+ */
+static bool convert_file_name(const std::string &utf8_name, std::basic_string<CHAR_T> &file_name)
+{
+#ifdef _WIN32
+	const int length = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, utf8_name.c_str(), -1, NULL, 0);
+	if(length <= 1)
+	{
+		return false;
+	}
+	std::vector<wchar_t> buffer(length);
+	if(MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, utf8_name.c_str(), -1, buffer.data(), length) != length)
+	{
+		return false;
+	}
+	file_name.assign(buffer.data());
+	return true;
+#else
+	file_name = utf8_name;
+	return !file_name.empty();
+#endif
+}
+
+/*
+ * Parse a single "<digest>  <file name>" line; the encoding of the digest (Hex, Base64 or Base85) is detected
+ * from the length, because the digest has a fixed size
+ */
+static bool parse_line(const std::string &line, check_entry_t &entry)
+{
+	const size_t separator = line.find("  ");
+	if((separator == std::string::npos) || (separator == 0U))
+	{
+		return false;
+	}
+
+	const std::string digest = line.substr(0U, separator);
+	bool valid;
+	if(digest.length() == 2U * MHASH384_SIZE)
+	{
+		valid = hex_to_bytes(digest, entry.digest, MHASH384_SIZE);
+	}
+	else if(digest.length() == ((4U * MHASH384_SIZE) + 2U) / 3U)
+	{
+		valid = base64_to_bytes(digest, entry.digest, MHASH384_SIZE);
+	}
+	else
+	{
+		valid = base85_to_bytes(digest, entry.digest, MHASH384_SIZE);
+	}
+
+	return valid && convert_file_name(line.substr(separator + 2U), entry.file_name);
+}
+
+/*
+ * Read all entries from the checksum file (or from stdin); empty lines are ignored, lines that could not be parsed
+ * are counted as malformed
+ */
+bool read_check_file(const CHAR_T *const file_name, std::vector<check_entry_t> &entries, size_t &malformed)
+{
+	errno = 0;
+	FILE *const input = file_name ? FOPEN(file_name, STR("r")) : stdin;
+	if(!input)
+	{
+		return false;
+	}
+
+	std::string line;
+	check_entry_t entry;
+	malformed = 0U;
+
+	while(read_line(input, line))
+	{
+		if(!line.empty())
+		{
+			if(parse_line(line, entry))
+			{
+				entries.push_back(entry);
+			}
+			else
+			{
+				++malformed;
+			}
+		}
+	}
+
+	const bool success = !ferror(input);
+	if(file_name)
+	{
+		fclose(input);
+	}
+
+	return success;
+}
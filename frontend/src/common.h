@@ -23,6 +23,7 @@
 
 #include <cstring>
 #include <cstdio>
+#include <cstdint>
 
 /* Old MSVC compat */
 #if defined(_MSC_VER) && (_MSC_VER <= 1600)
@@ -41,6 +42,8 @@
 #define STRPBRK wcspbrk
 #define STRICMP _wcsicmp
 #define STRNICMP _wcsnicmp
+#define STRTOUL wcstoul
+#define STRTOD wcstod
 #define FOPEN _wfopen
 #define FORCE_EXIT _exit
 #ifdef __USE_MINGW_ANSI_STDIO
@@ -59,6 +62,8 @@
 #define STRPBRK strpbrk
 #define STRICMP strcasecmp
 #define STRNICMP strncasecmp
+#define STRTOUL strtoul
+#define STRTOD strtod
 #define FOPEN fopen
 #define FORCE_EXIT _Exit
 #define PRI_char "s"
@@ -66,6 +71,8 @@
 #endif
 #define STR(X) _STR_(X)
 
+class DigestCache;
+
 /* User option flags */
 typedef struct
 {
@@ -74,6 +81,20 @@ typedef struct
 	int  base_enc;
 	bool lower_case;
 	bool benchmark;
+	bool benchmark_json;
+	bool verbose;
+	uint32_t thread_count;
+	int  io_engine;
+	bool pipeline;
+	bool direct;
+	bool recursive;
+	bool sorted;
+	bool tree;
+	const CHAR_T *cache_file;
+	double verify_ratio;
+	DigestCache *cache;
+	uint64_t mem_limit;
+	bool quick;
 }
 options_t;
 
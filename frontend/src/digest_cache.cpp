@@ -0,0 +1,465 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "digest_cache.h"
+
+#include <cstddef>
+#include <iterator>
+#include <sys/stat.h>
+#include <errno.h>
+
+/* POSIX stuff */
+#if !defined(_WIN32)
+#define HAVE_CACHE 1
+#include <ctime>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#if defined(__APPLE__)
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+#endif
+
+/* Header of the cache file */
+typedef struct
+{
+	char magic[8U];
+	uint32_t version;
+	uint32_t entry_size;
+}
+cache_header_t;
+
+static const char CACHE_MAGIC[8U] = { 'M', 'H', '3', '8', '4', 'C', 'A', 'C' };
+static const uint32_t CACHE_VERSION = 1U;
+
+/* Size of the key, i.e. all fields up to the "check" field */
+static const size_t CACHE_KEY_SIZE = offsetof(cache_entry_t, check);
+
+/* Files that have been modified less than this many nanoseconds before they were hashed are not cached */
+static const int64_t CACHE_RACY_NS = 2000000000;
+
+/*
+ * 64-Bit mixing function (finalizer of SplitMix64)
+ */
+static inline uint64_t mix64(uint64_t x)
+{
+	x = (x ^ (x >> 30U)) * 0xBF58476D1CE4E5B9;
+	x = (x ^ (x >> 27U)) * 0x94D049BB133111EB;
+	return x ^ (x >> 31U);
+}
+
+/*
+ * Checksum of an entry (FNV-1a), covering the key and the digest
+ */
+static uint32_t entry_checksum(const cache_entry_t &entry)
+{
+	const uint8_t *const key = reinterpret_cast<const uint8_t*>(&entry);
+	uint32_t hash = 0x811C9DC5;
+	for(size_t i = 0U; i < CACHE_KEY_SIZE; ++i)
+	{
+		hash = (hash ^ key[i]) * 0x01000193;
+	}
+	for(size_t i = 0U; i < MHASH384_SIZE; ++i)
+	{
+		hash = (hash ^ entry.digest[i]) * 0x01000193;
+	}
+	return hash;
+}
+
+/*
+ * Hash and comparison functions for the index; the index holds one entry per file, i.e. per device, inode and digest
+ * mode, so that the entries of files that have been modified are superseded
+ */
+size_t DigestCache::KeyHasher::operator()(const cache_entry_t *const entry) const
+{
+	return (size_t)mix64(entry->ino ^ mix64(entry->dev ^ entry->flags));
+}
+
+bool DigestCache::KeyEqualTo::operator()(const cache_entry_t *const a, const cache_entry_t *const b) const
+{
+	return (a->ino == b->ino) && (a->dev == b->dev) && (a->flags == b->flags);
+}
+
+/*
+ * Check whether the digest cache is supported on this platform
+ */
+bool cache_available(void)
+{
+#ifdef HAVE_CACHE
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Constructor
+ */
+DigestCache::DigestCache(const double verify_ratio)
+:
+	m_verify_ratio(verify_ratio),
+	m_verify_seed(mix64((uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)this)),
+	m_fd(-1),
+	m_map(NULL),
+	m_map_size(0U),
+	m_hits(0U),
+	m_misses(0U),
+	m_verified(0U),
+	m_mismatches(0U)
+{
+}
+
+/*
+ * Destructor
+ */
+DigestCache::~DigestCache(void)
+{
+	close();
+}
+
+#ifdef HAVE_CACHE
+
+/*
+ * Write the whole buffer, retrying after short writes
+ */
+static bool write_fully(const int fd, const void *const buffer, const size_t size)
+{
+	const uint8_t *const data = (const uint8_t*)buffer;
+	size_t total = 0U;
+	while(total < size)
+	{
+		const ssize_t count = write(fd, data + total, size - total);
+		if(count < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		total += (size_t)count;
+	}
+	return true;
+}
+
+/*
+ * Create the key of a file from its metadata
+ */
+static void make_key(cache_entry_t &key, const struct stat &file_info, const bool tree)
+{
+	memset(&key, 0, sizeof(cache_entry_t));
+	key.dev = (uint64_t)file_info.st_dev;
+	key.ino = (uint64_t)file_info.st_ino;
+	key.size = (uint64_t)file_info.st_size;
+	key.mtime_ns = ((int64_t)file_info.st_mtim.tv_sec * 1000000000) + file_info.st_mtim.tv_nsec;
+	key.ctime_ns = ((int64_t)file_info.st_ctim.tv_sec * 1000000000) + file_info.st_ctim.tv_nsec;
+	key.flags = tree ? 1U : 0U;
+}
+
+/*
+ * Open (or create) the cache file, and build the index of the existing entries
+ */
+bool DigestCache::open(const CHAR_T *const file_name, int &error_code)
+{
+	if((m_fd = ::open(file_name, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666)) < 0)
+	{
+		error_code = errno;
+		return false;
+	}
+	if(flock(m_fd, LOCK_EX | LOCK_NB))
+	{
+		error_code = errno; /*cache file is in use by another process*/
+		return false;
+	}
+
+	struct stat file_info;
+	if(fstat(m_fd, &file_info))
+	{
+		error_code = errno;
+		return false;
+	}
+
+	/* Write the header of a new file, or validate the header of an existing file */
+	cache_header_t header;
+	if(!file_info.st_size)
+	{
+		memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		header.version = CACHE_VERSION;
+		header.entry_size = sizeof(cache_entry_t);
+		if(!write_fully(m_fd, &header, sizeof(cache_header_t)))
+		{
+			error_code = errno;
+			return false;
+		}
+		return true;
+	}
+	if((pread(m_fd, &header, sizeof(cache_header_t), 0) != (ssize_t)sizeof(cache_header_t)) || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) || (header.version != CACHE_VERSION) || (header.entry_size != sizeof(cache_entry_t)))
+	{
+		error_code = EINVAL; /*not a cache file, or incompatible*/
+		return false;
+	}
+
+	/* Discard an incomplete entry at the end of the file, so that new entries are aligned */
+	const size_t count = (size_t)(((uint64_t)file_info.st_size - sizeof(cache_header_t)) / sizeof(cache_entry_t));
+	m_map_size = sizeof(cache_header_t) + (count * sizeof(cache_entry_t));
+	if((uint64_t)file_info.st_size != m_map_size)
+	{
+		if(ftruncate(m_fd, (off_t)m_map_size))
+		{
+			error_code = errno;
+			return false;
+		}
+	}
+	if(!count)
+	{
+		return true;
+	}
+
+	/* Map the entries and build the index; later entries supersede earlier entries */
+	void *const addr = mmap(NULL, m_map_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if(addr == MAP_FAILED)
+	{
+		error_code = errno;
+		return false;
+	}
+	m_map = addr;
+	madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+
+	const cache_entry_t *const entries = (const cache_entry_t*)((const uint8_t*)m_map + sizeof(cache_header_t));
+	size_t stale = 0U;
+	m_index.reserve(count);
+	for(size_t i = 0U; i < count; ++i)
+	{
+		if(entries[i].check != entry_checksum(entries[i]))
+		{
+			++stale; /*torn entry*/
+			continue;
+		}
+		const std::pair<index_t::iterator, bool> result = m_index.insert(&entries[i]);
+		if(!result.second)
+		{
+			m_index.erase(result.first);
+			m_index.insert(&entries[i]);
+			++stale;
+		}
+	}
+
+	/* Rewrite the file, if most of its entries have been superseded */
+	if((stale > m_index.size()) && (stale >= CACHE_FLUSH_COUNT))
+	{
+		return compact(file_name, error_code);
+	}
+	return true;
+}
+
+/*
+ * Write the current entries to a new file, which then replaces the cache file; the index keeps pointing into the
+ * mapping of the old file, which stays valid until it is unmapped
+ */
+bool DigestCache::compact(const CHAR_T *const file_name, int &error_code)
+{
+	const std::basic_string<CHAR_T> temp_name = std::basic_string<CHAR_T>(file_name) + STR(".tmp");
+	const int fd = ::open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if(fd < 0)
+	{
+		error_code = errno;
+		return false;
+	}
+
+	bool success = write_fully(fd, m_map, sizeof(cache_header_t));
+	std::vector<cache_entry_t> buffer;
+	buffer.reserve(CACHE_FLUSH_COUNT);
+	for(index_t::const_iterator iter = m_index.begin(); success && (iter != m_index.end()); ++iter)
+	{
+		buffer.push_back(**iter);
+		if((buffer.size() >= CACHE_FLUSH_COUNT) || (std::next(iter) == m_index.end()))
+		{
+			success = write_fully(fd, buffer.data(), buffer.size() * sizeof(cache_entry_t));
+			buffer.clear();
+		}
+	}
+	if(!(success && (!fsync(fd)) && (!rename(temp_name.c_str(), file_name))))
+	{
+		error_code = errno;
+		::close(fd);
+		unlink(temp_name.c_str());
+		return false;
+	}
+	::close(fd);
+
+	/* Continue with the new file */
+	const int new_fd = ::open(file_name, O_RDWR | O_APPEND | O_CLOEXEC);
+	if((new_fd < 0) || flock(new_fd, LOCK_EX | LOCK_NB))
+	{
+		error_code = errno;
+		if(new_fd >= 0)
+		{
+			::close(new_fd);
+		}
+		return false;
+	}
+	::close(m_fd);
+	m_fd = new_fd;
+	return true;
+}
+
+/*
+ * Append the buffered entries to the cache file; the caller must hold the mutex
+ */
+bool DigestCache::flush(void)
+{
+	bool success = true;
+	if((m_fd >= 0) && (!m_pending.empty()))
+	{
+		success = write_fully(m_fd, m_pending.data(), m_pending.size() * sizeof(cache_entry_t));
+	}
+	m_pending.clear();
+	return success;
+}
+
+/*
+ * Write the pending entries and close the cache file
+ */
+void DigestCache::close(void)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	flush();
+	m_index.clear();
+	if(m_map)
+	{
+		munmap(m_map, m_map_size);
+		m_map = NULL;
+	}
+	if(m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+/*
+ * Look up the digest of the given file; the key is returned even on a miss, so that it can be passed to insert()
+ */
+cache_lookup_t DigestCache::lookup(const CHAR_T *const file_name, const bool tree, cache_entry_t &key, uint8_t *const cached)
+{
+	struct stat file_info;
+	if(stat(file_name, &file_info) || (!S_ISREG(file_info.st_mode)))
+	{
+		return CACHE_NONE;
+	}
+	make_key(key, file_info, tree);
+
+	const index_t::const_iterator iter = m_index.find(&key);
+	if((iter == m_index.end()) || memcmp(*iter, &key, CACHE_KEY_SIZE))
+	{
+		++m_misses;
+		return CACHE_MISS;
+	}
+	memcpy(cached, (*iter)->digest, MHASH384_SIZE);
+
+	/* Select a random sample of the hits for verification */
+	if((m_verify_ratio > 0.0) && ((mix64(KeyHasher()(&key) ^ m_verify_seed) >> 11U) < (uint64_t)(m_verify_ratio * 9007199254740992.0)))
+	{
+		++m_verified;
+		return CACHE_VERIFY;
+	}
+	++m_hits;
+	return CACHE_HIT;
+}
+
+/*
+ * Add the digest of the given file to the cache, unless the file has been modified while it was hashed, or so
+ * recently that a subsequent modification could go unnoticed with the same timestamps
+ */
+void DigestCache::insert(const CHAR_T *const file_name, const cache_entry_t &key, const uint8_t *const digest)
+{
+	struct stat file_info;
+	cache_entry_t entry;
+	if(stat(file_name, &file_info))
+	{
+		return;
+	}
+	make_key(entry, file_info, key.flags != 0U);
+	if(memcmp(&entry, &key, CACHE_KEY_SIZE))
+	{
+		return; /*file has changed*/
+	}
+
+	struct timespec now;
+	if(clock_gettime(CLOCK_REALTIME, &now))
+	{
+		return;
+	}
+	const int64_t now_ns = ((int64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+	if((entry.mtime_ns > now_ns - CACHE_RACY_NS) || (entry.ctime_ns > now_ns - CACHE_RACY_NS))
+	{
+		return; /*racily clean*/
+	}
+
+	memcpy(entry.digest, digest, MHASH384_SIZE);
+	entry.check = entry_checksum(entry);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pending.push_back(entry);
+	if(m_pending.size() >= CACHE_FLUSH_COUNT)
+	{
+		flush();
+	}
+}
+
+#else
+
+bool DigestCache::open(const CHAR_T *const, int &error_code)
+{
+	error_code = ENOSYS;
+	return false;
+}
+
+void DigestCache::close(void)
+{
+}
+
+cache_lookup_t DigestCache::lookup(const CHAR_T *const, const bool, cache_entry_t&, uint8_t *const)
+{
+	return CACHE_NONE;
+}
+
+void DigestCache::insert(const CHAR_T *const, const cache_entry_t&, const uint8_t *const)
+{
+}
+
+#endif //HAVE_CACHE
+
+/*
+ * Get the cache statistics
+ */
+void DigestCache::get_stats(cache_stats_t &stats) const
+{
+	stats.hits = m_hits.load();
+	stats.misses = m_misses.load();
+	stats.verified = m_verified.load();
+	stats.mismatches = m_mismatches.load();
+}
@@ -0,0 +1,109 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_DIGEST_CACHE_H
+#define INC_MHASH384_DIGEST_CACHE_H
+
+#include "common.h"
+#include "mhash384.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+/* Number of new entries that are buffered, before they are appended to the cache file */
+static const size_t CACHE_FLUSH_COUNT = 256U;
+
+/* A single entry of the cache file; the "check" field detects entries that have been torn by a crash */
+typedef struct
+{
+	uint64_t dev, ino, size;
+	int64_t mtime_ns, ctime_ns;
+	uint32_t flags;  /*digest mode, e.g. tree hash*/
+	uint32_t check;
+	uint8_t digest[MHASH384_SIZE];
+}
+cache_entry_t;
+
+/* Result of a cache lookup */
+typedef enum
+{
+	CACHE_NONE   = 0,  /*file can not be cached, e.g. not a regular file*/
+	CACHE_MISS   = 1,
+	CACHE_HIT    = 2,
+	CACHE_VERIFY = 3   /*hit that has been selected for verification*/
+}
+cache_lookup_t;
+
+/* Cache statistics */
+typedef struct
+{
+	uint64_t hits, misses, verified, mismatches;
+}
+cache_stats_t;
+
+/*
+ * Persistent digest cache
+ *
+ * Maps the identity and the metadata of a regular file (device, inode, size, mtime and ctime) to its digest. The
+ * cache file is an append-only log of fixed-size entries; later entries of the same file supersede earlier ones. On
+ * open, the file is memory-mapped and indexed; the index is read-only afterwards, so lookups need no locking. New
+ * entries are buffered and appended to the end of the file. When most of the entries have been superseded, the file
+ * is compacted on open.
+ */
+class DigestCache
+{
+public:
+	DigestCache(const double verify_ratio);
+	~DigestCache(void);
+
+	bool open(const CHAR_T *const file_name, int &error_code);
+	void close(void);
+
+	cache_lookup_t lookup(const CHAR_T *const file_name, const bool tree, cache_entry_t &key, uint8_t *const cached);
+	void insert(const CHAR_T *const file_name, const cache_entry_t &key, const uint8_t *const digest);
+	void count_mismatch(void) { ++m_mismatches; }
+	void get_stats(cache_stats_t &stats) const;
+
+private:
+	DigestCache(const DigestCache&);
+	DigestCache &operator=(const DigestCache&);
+
+	struct KeyHasher { size_t operator()(const cache_entry_t *const entry) const; };
+	struct KeyEqualTo { bool operator()(const cache_entry_t *const a, const cache_entry_t *const b) const; };
+	typedef std::unordered_set<const cache_entry_t*, KeyHasher, KeyEqualTo> index_t;
+
+	bool compact(const CHAR_T *const file_name, int &error_code);
+	bool flush(void);
+
+	const double m_verify_ratio;
+	uint64_t m_verify_seed;
+	int m_fd;
+	void *m_map;
+	size_t m_map_size;
+	index_t m_index;
+	std::mutex m_mutex;
+	std::vector<cache_entry_t> m_pending;
+	std::atomic<uint64_t> m_hits, m_misses, m_verified, m_mismatches;
+};
+
+bool cache_available(void);
+
+#endif /*INC_MHASH384_DIGEST_CACHE_H*/
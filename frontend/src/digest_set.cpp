@@ -0,0 +1,335 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "digest_set.h"
+
+#include <cstdlib>
+#include <new>
+#include <errno.h>
+
+/* POSIX stuff */
+#if !defined(_WIN32)
+#define HAVE_PREAD 1
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/* Size of the huge pages, and of the smallest table that is allocated with huge pages */
+static const size_t HUGE_PAGE_SIZE = 2U << 20;
+
+/* Initial number of slots of each shard; the table grows, when it becomes more than 3/4 full */
+static const size_t INITIAL_SLOTS = 1024U;
+
+/* Mask of the fingerprint bits that are stored in the upper word of a slot */
+static const uint64_t FP_HI_MASK = 0xFFFFFF;
+
+/* Bytes per block of the side store */
+static const size_t BLOCK_BYTES = DIGEST_BLOCK_SIZE * MHASH384_SIZE;
+
+/*
+ * Load a 64-Bit little-endian word
+ */
+static inline uint64_t load64(const uint8_t *const data)
+{
+	uint64_t value = 0U;
+	for(size_t i = 0U; i < sizeof(uint64_t); ++i)
+	{
+		value |= ((uint64_t)data[i]) << (8U * i);
+	}
+	return value;
+}
+
+/* ======================================================================== */
+/* SLOT TABLE ALLOCATION                                                    */
+/* ======================================================================== */
+
+/*
+ * Allocate a zero-initialized table; large tables are backed by (transparent) huge pages, where available
+ */
+static void *alloc_table(const size_t size)
+{
+#if defined(HAVE_PREAD) && defined(MAP_ANONYMOUS)
+	if(size >= HUGE_PAGE_SIZE)
+	{
+		void *const addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(addr == MAP_FAILED)
+		{
+			throw std::bad_alloc();
+		}
+#ifdef MADV_HUGEPAGE
+		madvise(addr, size, MADV_HUGEPAGE);
+#endif
+		return addr;
+	}
+#endif
+	void *const ptr = calloc(size, 1U);
+	if(!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+static void free_table(void *const ptr, const size_t size)
+{
+#if defined(HAVE_PREAD) && defined(MAP_ANONYMOUS)
+	if(size >= HUGE_PAGE_SIZE)
+	{
+		munmap(ptr, size);
+		return;
+	}
+#endif
+	free(ptr);
+}
+
+/* ======================================================================== */
+/* SIDE STORE                                                               */
+/* ======================================================================== */
+
+DigestStore::DigestStore(void)
+:
+	m_file(NULL),
+	m_fd(-1),
+	m_size(0U),
+	m_failed(false)
+{
+#ifdef HAVE_PREAD
+	if((m_file = tmpfile())) /*file is deleted automatically*/
+	{
+		m_fd = fileno(m_file);
+	}
+#endif
+}
+
+DigestStore::~DigestStore(void)
+{
+	if(m_file)
+	{
+		fclose(m_file);
+	}
+}
+
+/*
+ * Append a full block to the temporary file; the offset of the block is returned
+ */
+bool DigestStore::write_block(const uint8_t *const data, uint64_t &offset)
+{
+#ifdef HAVE_PREAD
+	if(m_fd >= 0)
+	{
+		offset = m_size.fetch_add(BLOCK_BYTES);
+		size_t total = 0U;
+		while(total < BLOCK_BYTES)
+		{
+			const ssize_t count = pwrite(m_fd, data + total, BLOCK_BYTES - total, (off_t)(offset + total));
+			if(count < 0)
+			{
+				if(errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			total += (size_t)count;
+		}
+		return true;
+	}
+#endif
+	(void)data; (void)offset;
+	return false;
+}
+
+/*
+ * Read a single digest back from the temporary file; a failure is remembered, so that the caller can detect it
+ */
+bool DigestStore::read_digest(const uint64_t offset, uint8_t *const digest_out)
+{
+#ifdef HAVE_PREAD
+	ssize_t count;
+	do
+	{
+		count = pread(m_fd, digest_out, MHASH384_SIZE, (off_t)offset);
+	}
+	while((count < 0) && (errno == EINTR));
+	if(count != (ssize_t)MHASH384_SIZE)
+	{
+		m_failed = true;
+		return false;
+	}
+	return true;
+#else
+	(void)offset; (void)digest_out;
+	m_failed = true;
+	return false;
+#endif
+}
+
+/* ======================================================================== */
+/* FLAT DIGEST SET                                                          */
+/* ======================================================================== */
+
+FlatDigestSet::FlatDigestSet(void)
+:
+	m_slots((slot_t*)alloc_table(INITIAL_SLOTS * sizeof(slot_t))),
+	m_mask(INITIAL_SLOTS - 1U),
+	m_size(0U)
+{
+}
+
+FlatDigestSet::~FlatDigestSet(void)
+{
+	free_table(m_slots, (m_mask + 1U) * sizeof(slot_t));
+}
+
+/*
+ * Double the number of slots; only the fingerprints are re-inserted, the side store is left untouched
+ */
+void FlatDigestSet::grow(void)
+{
+	const size_t old_count = m_mask + 1U, new_mask = (old_count << 1U) - 1U;
+	slot_t *const new_slots = (slot_t*)alloc_table((new_mask + 1U) * sizeof(slot_t));
+	for(size_t i = 0U; i < old_count; ++i)
+	{
+		if(m_slots[i].hi)
+		{
+			size_t idx = (size_t)m_slots[i].lo & new_mask;
+			while(new_slots[idx].hi)
+			{
+				idx = (idx + 1U) & new_mask;
+			}
+			new_slots[idx] = m_slots[i];
+		}
+	}
+	free_table(m_slots, old_count * sizeof(slot_t));
+	m_slots = new_slots;
+	m_mask = new_mask;
+}
+
+/*
+ * Load the full digest with the given index from the side store
+ */
+bool FlatDigestSet::load_digest(DigestStore &store, const uint64_t index, uint8_t *const digest_out)
+{
+	const block_t &block = m_blocks[(size_t)(index / DIGEST_BLOCK_SIZE)];
+	const size_t pos = (size_t)(index % DIGEST_BLOCK_SIZE) * MHASH384_SIZE;
+	if(block.data)
+	{
+		memcpy(digest_out, block.data.get() + pos, MHASH384_SIZE);
+		return true;
+	}
+	return store.read_digest(block.offset + pos, digest_out);
+}
+
+/*
+ * Insert the digest; returns false, if the digest was already contained in the set. If a stored digest could not be
+ * read back, the digest is not inserted and true is returned, so that no false collision is reported; the failure
+ * is flagged by the side store instead.
+ */
+bool FlatDigestSet::insert(DigestStore &store, const uint8_t *const digest)
+{
+	const uint64_t fp_lo = load64(digest), fp_hi = load64(digest + sizeof(uint64_t)) & FP_HI_MASK;
+	if((m_size + 1U) * 4U > (m_mask + 1U) * 3U)
+	{
+		grow();
+	}
+
+	size_t idx = (size_t)fp_lo & m_mask;
+	for(; m_slots[idx].hi; idx = (idx + 1U) & m_mask)
+	{
+		if((m_slots[idx].lo == fp_lo) && ((m_slots[idx].hi & FP_HI_MASK) == fp_hi))
+		{
+			uint8_t stored[MHASH384_SIZE];
+			if(!load_digest(store, (m_slots[idx].hi >> 24U) - 1U, stored))
+			{
+				return true; /*I/O error, see DigestStore::failed()*/
+			}
+			if(!memcmp(stored, digest, MHASH384_SIZE))
+			{
+				return false; /*duplicate*/
+			}
+		}
+	}
+
+	/* Append the full digest to the current block of the side store */
+	const uint64_t index = m_size++;
+	const size_t pos = (size_t)(index % DIGEST_BLOCK_SIZE) * MHASH384_SIZE;
+	if(!pos)
+	{
+		m_blocks.push_back(block_t());
+		m_blocks.back().offset = 0U;
+		m_blocks.back().data.reset(new uint8_t[BLOCK_BYTES]);
+	}
+	block_t &block = m_blocks.back();
+	memcpy(block.data.get() + pos, digest, MHASH384_SIZE);
+	if((pos + MHASH384_SIZE == BLOCK_BYTES) && store.write_block(block.data.get(), block.offset))
+	{
+		block.data.reset(); /*block is in the file now*/
+	}
+
+	m_slots[idx].lo = fp_lo;
+	m_slots[idx].hi = fp_hi | ((index + 1U) << 24U);
+	return true;
+}
+
+/*
+ * Memory used by the slot table and by the blocks that are held in memory
+ */
+uint64_t FlatDigestSet::memory_usage(void) const
+{
+	uint64_t total = (m_mask + 1U) * sizeof(slot_t) + (m_blocks.capacity() * sizeof(block_t));
+	for(std::vector<block_t>::const_iterator iter = m_blocks.begin(); iter != m_blocks.end(); ++iter)
+	{
+		total += iter->data ? BLOCK_BYTES : 0U;
+	}
+	return total;
+}
+
+/* ======================================================================== */
+/* SHARDED DIGEST SET                                                       */
+/* ======================================================================== */
+
+bool ShardedDigestSet::insert(const uint8_t *const digest)
+{
+	shard_t &shard = m_shards[(((size_t)digest[MHASH384_SIZE - 2U] << 8U) | digest[MHASH384_SIZE - 1U]) % DIGEST_SHARD_COUNT];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	return shard.set.insert(m_store, digest);
+}
+
+uint64_t ShardedDigestSet::size(void)
+{
+	uint64_t total = 0U;
+	for(std::vector<shard_t>::iterator iter = m_shards.begin(); iter != m_shards.end(); ++iter)
+	{
+		std::lock_guard<std::mutex> lock(iter->mutex);
+		total += iter->set.size();
+	}
+	return total;
+}
+
+uint64_t ShardedDigestSet::memory_usage(void)
+{
+	uint64_t total = 0U;
+	for(std::vector<shard_t>::iterator iter = m_shards.begin(); iter != m_shards.end(); ++iter)
+	{
+		std::lock_guard<std::mutex> lock(iter->mutex);
+		total += iter->set.memory_usage();
+	}
+	return total;
+}
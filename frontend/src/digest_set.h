@@ -0,0 +1,136 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_DIGEST_SET_H
+#define INC_MHASH384_DIGEST_SET_H
+
+#include "common.h"
+#include "mhash384.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* Number of digests per block of the side store */
+static const size_t DIGEST_BLOCK_SIZE = 1024U;
+
+/* Number of shards of the digest set */
+static const size_t DIGEST_SHARD_COUNT = 256U;
+
+/*
+ * Side store of the full digests; the digests of each shard are collected in blocks, and every full block is written
+ * to an anonymous temporary file, at an offset that is allocated atomically. If the temporary file could not be
+ * created (or on Windows), the blocks are kept in memory.
+ */
+class DigestStore
+{
+public:
+	DigestStore(void);
+	~DigestStore(void);
+
+	bool write_block(const uint8_t *const data, uint64_t &offset);
+	bool read_digest(const uint64_t offset, uint8_t *const digest_out);
+	bool file_backed(void) const { return m_fd >= 0; }
+	bool failed(void) const { return m_failed.load(); }
+
+private:
+	DigestStore(const DigestStore&);
+	DigestStore &operator=(const DigestStore&);
+
+	FILE *m_file;
+	int m_fd;
+	std::atomic<uint64_t> m_size;
+	std::atomic<bool> m_failed;
+};
+
+/*
+ * Flat open-addressing set of digests, used by a single shard
+ *
+ * Every slot takes 16 bytes: an 88-bit fingerprint (the leading bytes of the digest) and the 40-bit index of the full
+ * digest in the side store. Collisions are resolved by linear probing. The full digest is only read back, if the
+ * fingerprints match, i.e. for duplicates. The slot table is allocated with huge pages, where available.
+ */
+class FlatDigestSet
+{
+public:
+	FlatDigestSet(void);
+	~FlatDigestSet(void);
+
+	bool insert(DigestStore &store, const uint8_t *const digest);
+	uint64_t size(void) const { return m_size; }
+	uint64_t memory_usage(void) const;
+
+private:
+	FlatDigestSet(const FlatDigestSet&);
+	FlatDigestSet &operator=(const FlatDigestSet&);
+
+	typedef struct
+	{
+		uint64_t lo;  /*fingerprint, bits 0 to 63*/
+		uint64_t hi;  /*fingerprint, bits 64 to 87 + (index + 1) << 24, zero for an empty slot*/
+	}
+	slot_t;
+
+	typedef struct
+	{
+		uint64_t offset;  /*offset in the side store file, if the block has been written*/
+		std::unique_ptr<uint8_t[]> data;
+	}
+	block_t;
+
+	void grow(void);
+	bool load_digest(DigestStore &store, const uint64_t index, uint8_t *const digest_out);
+
+	slot_t *m_slots;
+	size_t m_mask;
+	uint64_t m_size;
+	std::vector<block_t> m_blocks;
+};
+
+/*
+ * Set of digests, split into shards that are selected by the trailing digest bytes; each shard has its own lock
+ */
+class ShardedDigestSet
+{
+public:
+	ShardedDigestSet(void) : m_shards(DIGEST_SHARD_COUNT) { }
+
+	bool insert(const uint8_t *const digest);
+	uint64_t size(void);
+	uint64_t memory_usage(void);
+	bool file_backed(void) const { return m_store.file_backed(); }
+	bool failed(void) const { return m_store.failed(); }
+
+private:
+	ShardedDigestSet(const ShardedDigestSet&);
+	ShardedDigestSet &operator=(const ShardedDigestSet&);
+
+	typedef struct
+	{
+		std::mutex mutex;
+		FlatDigestSet set;
+	}
+	shard_t;
+
+	DigestStore m_store;
+	std::vector<shard_t> m_shards;
+};
+
+#endif /*INC_MHASH384_DIGEST_SET_H*/
@@ -0,0 +1,446 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "dir_walker.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <chrono>
+#include <thread>
+#include <sys/stat.h>
+#include <errno.h>
+
+/* Win32 stuff */
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#endif
+
+/* POSIX stuff */
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#endif
+
+/* Linux stuff */
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if defined(SYS_getdents64)
+#define HAVE_GETDENTS64 1
+#endif
+#endif
+
+/* Maximum number of directories that are held open by the queued jobs */
+static const size_t MAX_OPEN_DIRS = 256U;
+
+/* Size of the buffer for reading directory entries */
+static const size_t DIRENT_BUFFER_SIZE = 32768U;
+
+/* Type of a directory entry */
+typedef enum
+{
+	ENTRY_FILE      = 0,
+	ENTRY_DIRECTORY = 1,
+	ENTRY_OTHER     = 2
+}
+entry_type_t;
+
+#ifdef HAVE_GETDENTS64
+typedef struct
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1U];
+}
+linux_dirent64_t;
+#endif
+
+/* ======================================================================== */
+/* HELPER FUNCTIONS                                                         */
+/* ======================================================================== */
+
+static inline bool is_dot_entry(const CHAR_T *const name)
+{
+	return (name[0U] == STR('.')) && ((!name[1U]) || ((name[1U] == STR('.')) && (!name[2U])));
+}
+
+static DirWalker::path_t join_path(const DirWalker::path_t &parent, const CHAR_T *const name)
+{
+#ifdef _WIN32
+	static const CHAR_T SEPARATOR = STR('\\');
+	const bool have_separator = (!parent.empty()) && ((parent[parent.length() - 1U] == STR('\\')) || (parent[parent.length() - 1U] == STR('/')));
+#else
+	static const CHAR_T SEPARATOR = STR('/');
+	const bool have_separator = (!parent.empty()) && (parent[parent.length() - 1U] == STR('/'));
+#endif
+	DirWalker::path_t path(parent);
+	if(!have_separator)
+	{
+		path += SEPARATOR;
+	}
+	return path.append(name);
+}
+
+/*
+ * Check whether the path (as specified on the command-line) refers to a directory; symbolic links are followed
+ */
+static bool is_directory(const CHAR_T *const path)
+{
+#ifdef _WIN32
+	const DWORD attributes = GetFileAttributesW(path);
+	return (attributes != INVALID_FILE_ATTRIBUTES) && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat info;
+	return (!stat(path, &info)) && S_ISDIR(info.st_mode);
+#endif
+}
+
+#if !defined(_WIN32)
+
+/*
+ * Determine the type of a directory entry; symbolic links to regular files are followed, but symbolic links to
+ * directories are *not*, so that we can not run into a cycle
+ */
+static entry_type_t get_entry_type(const int dir_fd, const char *const name, const unsigned char d_type)
+{
+#ifdef DT_UNKNOWN
+	switch(d_type)
+	{
+	case DT_REG:
+		return ENTRY_FILE;
+	case DT_DIR:
+		return ENTRY_DIRECTORY;
+	case DT_LNK:
+	case DT_UNKNOWN:
+		break;
+	default:
+		return ENTRY_OTHER;
+	}
+#else
+	(void)d_type;
+#endif
+	struct stat info;
+	if(fstatat(dir_fd, name, &info, AT_SYMLINK_NOFOLLOW))
+	{
+		return ENTRY_OTHER;
+	}
+	if(S_ISLNK(info.st_mode))
+	{
+		return ((!fstatat(dir_fd, name, &info, 0)) && S_ISREG(info.st_mode)) ? ENTRY_FILE : ENTRY_OTHER;
+	}
+	return S_ISREG(info.st_mode) ? ENTRY_FILE : (S_ISDIR(info.st_mode) ? ENTRY_DIRECTORY : ENTRY_OTHER);
+}
+
+#endif //_WIN32
+
+/* ======================================================================== */
+/* DIRECTORY WALKER                                                         */
+/* ======================================================================== */
+
+/*
+ * Constructor
+ */
+DirWalker::DirWalker(ThreadPool &pool, const walk_filter_t &filter)
+:
+	m_pool(pool),
+	m_filter(filter),
+	m_queues(pool.thread_count()),
+	m_pending(0U),
+	m_open_dirs(0U)
+{
+}
+
+/*
+ * Destructor
+ */
+DirWalker::~DirWalker(void)
+{
+#if !defined(_WIN32)
+	for(std::vector<queue_t>::iterator iter = m_queues.begin(); iter != m_queues.end(); ++iter)
+	{
+		for(std::deque<job_t>::const_iterator job = iter->jobs.begin(); job != iter->jobs.end(); ++job)
+		{
+			if(job->fd >= 0)
+			{
+				close(job->fd); /*left over after cancellation*/
+			}
+		}
+	}
+#endif
+}
+
+/*
+ * Walk the given paths; returns when all files have been processed, or when the pool has been cancelled
+ */
+void DirWalker::run(const CHAR_T *const *const paths, const size_t count, const file_fn_t &file_fn, const error_fn_t &error_fn)
+{
+	m_file_fn = file_fn;
+	m_error_fn = error_fn;
+	for(size_t i = 0U; i < count; ++i)
+	{
+		push_job(i % m_queues.size(), path_t(paths[i]), -1, is_directory(paths[i]));
+	}
+	m_pool.start(m_pool.thread_count(), [this](const size_t worker_id, const size_t)
+	{
+		worker_main(worker_id);
+	});
+	m_pool.wait();
+}
+
+/*
+ * Worker thread: process jobs until there are none left anywhere
+ */
+void DirWalker::worker_main(const size_t worker_id)
+{
+	job_t job;
+	unsigned int idle = 0U;
+	while(!m_pool.cancelled())
+	{
+		if(next_job(worker_id, job))
+		{
+			if(job.directory)
+			{
+				scan_directory(worker_id, job);
+			}
+			else
+			{
+				m_file_fn(worker_id, job.path);
+			}
+			m_pending.fetch_sub(1U); /*after the children have been pushed*/
+			idle = 0U;
+		}
+		else if(!m_pending.load())
+		{
+			break; /*all work is done*/
+		}
+		else if(++idle < 64U)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+}
+
+/*
+ * Add a new job to the back of the worker's own queue
+ */
+void DirWalker::push_job(const size_t worker_id, const path_t &path, const int fd, const bool directory)
+{
+	job_t job;
+	job.path = path;
+	job.fd = fd;
+	job.directory = directory;
+	m_pending.fetch_add(1U);
+	queue_t &queue = m_queues[worker_id];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	queue.jobs.push_back(job);
+}
+
+/*
+ * Fetch the next job, either from the back of the own queue or from the front of another worker's queue
+ */
+bool DirWalker::next_job(const size_t worker_id, job_t &job)
+{
+	{
+		queue_t &own = m_queues[worker_id];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if(!own.jobs.empty())
+		{
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+	for(size_t i = 1U; i < m_queues.size(); ++i)
+	{
+		queue_t &other = m_queues[(worker_id + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if(!other.jobs.empty())
+		{
+			job = other.jobs.front();
+			other.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Apply the include and exclude patterns to the name of a directory entry
+ */
+bool DirWalker::included(const CHAR_T *const name, const bool directory) const
+{
+	for(std::vector<const CHAR_T*>::const_iterator iter = m_filter.exclude.begin(); iter != m_filter.exclude.end(); ++iter)
+	{
+		if(glob_match(*iter, name))
+		{
+			return false;
+		}
+	}
+	if(directory || m_filter.include.empty())
+	{
+		return true;
+	}
+	for(std::vector<const CHAR_T*>::const_iterator iter = m_filter.include.begin(); iter != m_filter.include.end(); ++iter)
+	{
+		if(glob_match(*iter, name))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef _WIN32
+
+/*
+ * Read all entries of the directory (Win32 version)
+ */
+void DirWalker::scan_directory(const size_t worker_id, const job_t &job)
+{
+	WIN32_FIND_DATAW data;
+	const HANDLE handle = FindFirstFileExW(join_path(job.path, L"*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if(handle == INVALID_HANDLE_VALUE)
+	{
+		m_error_fn(job.path, (int)GetLastError());
+		return;
+	}
+	do
+	{
+		if(is_dot_entry(data.cFileName))
+		{
+			continue;
+		}
+		const bool directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		if(directory && (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+		{
+			continue; /*do not follow junctions and symbolic links to directories*/
+		}
+		if(included(data.cFileName, directory))
+		{
+			push_job(worker_id, join_path(job.path, data.cFileName), -1, directory);
+		}
+	}
+	while((!m_pool.cancelled()) && FindNextFileW(handle, &data));
+	FindClose(handle);
+}
+
+#else
+
+/*
+ * Read all entries of the directory (POSIX version); directories that are still closed are opened by path
+ */
+void DirWalker::scan_directory(const size_t worker_id, const job_t &job)
+{
+	int dir_fd = job.fd;
+	if(dir_fd >= 0)
+	{
+		m_open_dirs.fetch_sub(1U);
+	}
+	else if((dir_fd = open(job.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+	{
+		m_error_fn(job.path, errno);
+		return;
+	}
+
+	const auto add_entry = [&](const char *const name, const entry_type_t type)
+	{
+		if((type == ENTRY_OTHER) || (!included(name, type == ENTRY_DIRECTORY)))
+		{
+			return;
+		}
+		int child_fd = -1;
+		if((type == ENTRY_DIRECTORY) && (m_open_dirs.load() < MAX_OPEN_DIRS))
+		{
+			if((child_fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) >= 0)
+			{
+				m_open_dirs.fetch_add(1U);
+			}
+		}
+		push_job(worker_id, join_path(job.path, name), child_fd, type == ENTRY_DIRECTORY);
+	};
+
+#ifdef HAVE_GETDENTS64
+	uint64_t buffer[DIRENT_BUFFER_SIZE / sizeof(uint64_t)];
+	while(!m_pool.cancelled())
+	{
+		const long length = syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer));
+		if(length <= 0)
+		{
+			if(length < 0)
+			{
+				m_error_fn(job.path, errno);
+			}
+			break;
+		}
+		for(long pos = 0; pos < length; )
+		{
+			const linux_dirent64_t *const entry = (const linux_dirent64_t*)(((const uint8_t*)buffer) + pos);
+			pos += entry->d_reclen;
+			if(!is_dot_entry(entry->d_name))
+			{
+				add_entry(entry->d_name, get_entry_type(dir_fd, entry->d_name, entry->d_type));
+			}
+		}
+	}
+	close(dir_fd);
+#else
+	DIR *const dir = fdopendir(dir_fd);
+	if(!dir)
+	{
+		m_error_fn(job.path, errno);
+		close(dir_fd);
+		return;
+	}
+	errno = 0;
+	while(!m_pool.cancelled())
+	{
+		const struct dirent *const entry = readdir(dir);
+		if(!entry)
+		{
+			if(errno)
+			{
+				m_error_fn(job.path, errno);
+			}
+			break;
+		}
+		if(!is_dot_entry(entry->d_name))
+		{
+#ifdef DT_UNKNOWN
+			add_entry(entry->d_name, get_entry_type(dirfd(dir), entry->d_name, entry->d_type));
+#else
+			add_entry(entry->d_name, get_entry_type(dirfd(dir), entry->d_name, 0U));
+#endif
+		}
+	}
+	closedir(dir);
+#endif
+}
+
+#endif //_WIN32
@@ -0,0 +1,98 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_DIR_WALKER_H
+#define INC_MHASH384_DIR_WALKER_H
+
+#include "common.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+/* Glob patterns that select the files and directories */
+typedef struct
+{
+	std::vector<const CHAR_T*> include;  /*files must match one of these, if any*/
+	std::vector<const CHAR_T*> exclude;  /*files and directories matching any of these are skipped*/
+}
+walk_filter_t;
+
+/*
+ * Parallel directory walker
+ *
+ * Walks the given paths recursively and invokes the file function for every regular file that has been found. The
+ * work runs on the worker threads of the given pool: every worker owns a double-ended queue of pending directories
+ * and files; it takes the most recently discovered entry from the back of its own queue (depth-first), while a
+ * worker that has run out of work steals the oldest entry (i.e. the one closest to the root) from the front of
+ * another worker's queue. Directories are read with getdents64() on Linux, and sub-directories are opened relative
+ * to their parent with openat(), as long as the number of open directories stays below a fixed limit.
+ */
+class DirWalker
+{
+public:
+	typedef std::basic_string<CHAR_T> path_t;
+	typedef std::function<void(const size_t worker_id, const path_t &path)> file_fn_t;
+	typedef std::function<void(const path_t &path, const int error_code)> error_fn_t;
+
+	DirWalker(ThreadPool &pool, const walk_filter_t &filter);
+	~DirWalker(void);
+
+	void run(const CHAR_T *const *const paths, const size_t count, const file_fn_t &file_fn, const error_fn_t &error_fn);
+
+private:
+	DirWalker(const DirWalker&);
+	DirWalker &operator=(const DirWalker&);
+
+	typedef struct
+	{
+		path_t path;
+		int fd;          /*directory that has already been opened, or -1*/
+		bool directory;
+	}
+	job_t;
+
+	typedef struct
+	{
+		std::mutex mutex;
+		std::deque<job_t> jobs;
+	}
+	queue_t;
+
+	void worker_main(const size_t worker_id);
+	void push_job(const size_t worker_id, const path_t &path, const int fd, const bool directory);
+	bool next_job(const size_t worker_id, job_t &job);
+	void scan_directory(const size_t worker_id, const job_t &job);
+	bool included(const CHAR_T *const name, const bool directory) const;
+
+	ThreadPool &m_pool;
+	const walk_filter_t &m_filter;
+	std::vector<queue_t> m_queues;
+	std::atomic<size_t> m_pending;    /*jobs that are queued or running*/
+	std::atomic<size_t> m_open_dirs;  /*directories that are held open by queued jobs*/
+	file_fn_t m_file_fn;
+	error_fn_t m_error_fn;
+};
+
+#endif /*INC_MHASH384_DIR_WALKER_H*/
@@ -0,0 +1,690 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "file_io.h"
+#include "thread_pool.h"
+#include "uring.h"
+#include "tree_hash.h"
+#include "digest_cache.h"
+#include "phase_timer.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <sys/stat.h>
+#include <errno.h>
+
+/* Win32 I/O stuff */
+#if defined(_WIN32) && defined(_MSC_VER)
+#define fstat _fstat
+#define stat _stat
+#define fileno _fileno
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/* POSIX I/O stuff */
+#if !defined(_WIN32)
+#define HAVE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+#endif
+
+/* Size of the mapped window, and of the steps in which the window is processed */
+static const uint64_t MMAP_WINDOW_SIZE = 64U << 20;
+static const size_t   MMAP_STEP_SIZE   =  1U << 20;
+
+/* Alignment of the pipeline buffers */
+static const size_t PIPELINE_ALIGNMENT = 4096U;
+
+/* Pipeline statistics */
+static std::atomic<uint64_t> g_reader_stall_ns(0U), g_hasher_stall_ns(0U), g_pipeline_buffers(0U);
+
+/*
+ * Check whether the cancellation has been requested
+ */
+static inline bool is_cancelled(const ThreadPool *const pool)
+{
+	return pool && pool->cancelled();
+}
+
+/* ======================================================================== */
+/* I/O CONTEXT                                                              */
+/* ======================================================================== */
+
+static uint8_t *alloc_aligned(const size_t size, const size_t alignment)
+{
+#ifdef _WIN32
+	void *const ptr = _aligned_malloc(size, alignment);
+#else
+	void *ptr = NULL;
+	if(posix_memalign(&ptr, alignment, size))
+	{
+		ptr = NULL;
+	}
+#endif
+	if(!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return (uint8_t*)ptr;
+}
+
+static void free_aligned(uint8_t *const ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+IOContext::IOContext(void)
+:
+	m_buffer(NULL),
+	m_uring(NULL),
+	m_uring_failed(false)
+{
+	memset(m_ring, 0, sizeof(m_ring));
+}
+
+IOContext::~IOContext(void)
+{
+	delete[] m_buffer;
+	for(size_t i = 0U; i < PIPELINE_RING_SIZE; ++i)
+	{
+		if(m_ring[i])
+		{
+			free_aligned(m_ring[i]);
+		}
+	}
+	uring_destroy(m_uring);
+}
+
+uint8_t *IOContext::buffer(void)
+{
+	if(!m_buffer)
+	{
+		m_buffer = new uint8_t[BUFFER_SIZE];
+	}
+	return m_buffer;
+}
+
+uint8_t *IOContext::ring_buffer(const size_t index)
+{
+	if(!m_ring[index])
+	{
+		m_ring[index] = alloc_aligned(PIPELINE_BUFFER_SIZE, PIPELINE_ALIGNMENT);
+	}
+	return m_ring[index];
+}
+
+uring_t *IOContext::uring(void)
+{
+	if((!m_uring) && (!m_uring_failed))
+	{
+		m_uring_failed = !(m_uring = uring_create());
+	}
+	return m_uring;
+}
+
+/* ======================================================================== */
+/* STDIO ENGINE                                                             */
+/* ======================================================================== */
+
+/*
+ * Read the input through the given buffer
+ */
+static file_status_t read_stdio(FILE *const input, uint8_t *const buffer, MHash384 &mhash384, const ThreadPool *const pool)
+{
+	for(;;)
+	{
+		const size_t length = fread(buffer, sizeof(uint8_t), BUFFER_SIZE, input);
+		if(!length)
+		{
+			break; /*EOF or error*/
+		}
+		{
+			PhaseTimer timer(PHASE_HASH, length);
+			mhash384.update(buffer, length);
+		}
+		if(is_cancelled(pool))
+		{
+			return FILE_CANCELLED;
+		}
+	}
+	return ferror(input) ? FILE_READ_ERROR : FILE_SUCCESS;
+}
+
+/* ======================================================================== */
+/* PIPELINE                                                                 */
+/* ======================================================================== */
+
+/*
+ * Single-producer/single-consumer ring of buffers; the reader thread fills the buffers, the hasher thread consumes
+ * them. The two sides only synchronize through the "head" and "tail" counters, no locks are involved.
+ */
+typedef struct
+{
+	uint8_t *data[PIPELINE_RING_SIZE];
+	size_t length[PIPELINE_RING_SIZE];
+	std::atomic<size_t> head;  /*number of buffers filled by the reader*/
+	std::atomic<size_t> tail;  /*number of buffers consumed by the hasher*/
+	std::atomic<bool> stop;    /*hasher has given up, reader must stop*/
+	bool read_error;
+}
+pipeline_t;
+
+/*
+ * Wait until the given condition is satisfied, or "stop" has been set; returns the time spent waiting
+ */
+template<typename T> static uint64_t pipeline_wait(const T &ready, const std::atomic<bool> &stop)
+{
+	if(ready() || stop.load(std::memory_order_relaxed))
+	{
+		return 0U;
+	}
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(unsigned int spin = 0U; !(ready() || stop.load(std::memory_order_relaxed)); ++spin)
+	{
+		if(spin < 64U)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Reader thread: fill the buffers until EOF or error; an empty buffer marks the end of the input. The read function
+ * returns the number of bytes that have been read, zero at EOF, or a negative value on error.
+ */
+template<typename R> static void pipeline_reader(const R read_fn, pipeline_t *const pipeline)
+{
+	uint64_t stall_ns = 0U;
+	for(size_t head = 0U; ; ++head)
+	{
+		stall_ns += pipeline_wait([&]() { return head - pipeline->tail.load(std::memory_order_acquire) < PIPELINE_RING_SIZE; }, pipeline->stop);
+		if(pipeline->stop.load(std::memory_order_relaxed))
+		{
+			break;
+		}
+		const size_t slot = head % PIPELINE_RING_SIZE;
+		const ptrdiff_t length = read_fn(pipeline->data[slot], PIPELINE_BUFFER_SIZE);
+		pipeline->length[slot] = (length > 0) ? (size_t)length : 0U;
+		if(length <= 0)
+		{
+			pipeline->read_error = (length < 0);
+		}
+		pipeline->head.store(head + 1U, std::memory_order_release);
+		if(length <= 0)
+		{
+			break; /*EOF or error*/
+		}
+	}
+	g_reader_stall_ns += stall_ns;
+}
+
+/*
+ * Read the input on a separate reader thread, while the calling thread does the hashing
+ */
+template<typename R> static file_status_t read_pipeline(const R read_fn, IOContext &context, MHash384 &mhash384, const ThreadPool *const pool)
+{
+	pipeline_t pipeline;
+	for(size_t i = 0U; i < PIPELINE_RING_SIZE; ++i)
+	{
+		pipeline.data[i] = context.ring_buffer(i);
+		pipeline.length[i] = 0U;
+	}
+	pipeline.head.store(0U);
+	pipeline.tail.store(0U);
+	pipeline.stop.store(false);
+	pipeline.read_error = false;
+
+	std::thread reader(pipeline_reader<R>, read_fn, &pipeline);
+	file_status_t status = FILE_SUCCESS;
+	uint64_t stall_ns = 0U, buffers = 0U;
+
+	for(size_t tail = 0U; ; ++tail)
+	{
+		stall_ns += pipeline_wait([&]() { return pipeline.head.load(std::memory_order_acquire) > tail; }, pipeline.stop);
+		const size_t slot = tail % PIPELINE_RING_SIZE;
+		if(!pipeline.length[slot])
+		{
+			status = pipeline.read_error ? FILE_READ_ERROR : FILE_SUCCESS;
+			break;
+		}
+		{
+			PhaseTimer timer(PHASE_HASH, pipeline.length[slot]);
+			mhash384.update(pipeline.data[slot], pipeline.length[slot]);
+		}
+		pipeline.tail.store(tail + 1U, std::memory_order_release);
+		++buffers;
+		if(is_cancelled(pool))
+		{
+			pipeline.stop.store(true);
+			status = FILE_CANCELLED;
+			break;
+		}
+	}
+
+	reader.join();
+	g_hasher_stall_ns += stall_ns;
+	g_pipeline_buffers += buffers;
+	return status;
+}
+
+/* ======================================================================== */
+/* MMAP ENGINE                                                              */
+/* ======================================================================== */
+
+#ifdef HAVE_MMAP
+
+/*
+ * Map the regular file window by window and pass the mapped pages directly to the hash function; the pages behind
+ * the cursor are released right away, so that the resident set stays small even for very large files. If the file
+ * can not be mapped at all (e.g. sysfs), nothing has been hashed yet and the caller has to fall back to stdio
+ */
+static file_status_t read_mmap(const int fd, const uint64_t file_size, MHash384 &mhash384, const ThreadPool *const pool, bool &unmappable)
+{
+	unmappable = false;
+	for(uint64_t offset = 0U; offset < file_size; offset += MMAP_WINDOW_SIZE)
+	{
+		const size_t window_size = (size_t)std::min(file_size - offset, MMAP_WINDOW_SIZE);
+		void *const addr = mmap(NULL, window_size, PROT_READ, MAP_PRIVATE, fd, (off_t)offset);
+		if(addr == MAP_FAILED)
+		{
+			unmappable = (offset == 0U);
+			return FILE_READ_ERROR;
+		}
+		madvise(addr, window_size, MADV_SEQUENTIAL);
+		uint8_t *const window = (uint8_t*)addr;
+		for(size_t pos = 0U; pos < window_size; pos += MMAP_STEP_SIZE)
+		{
+			const size_t length = std::min(window_size - pos, MMAP_STEP_SIZE);
+			{
+				PhaseTimer timer(PHASE_HASH, length); /*includes the page faults*/
+				mhash384.update(window + pos, length);
+			}
+			madvise(window + pos, length, MADV_DONTNEED);
+			if(is_cancelled(pool))
+			{
+				munmap(addr, window_size);
+				return FILE_CANCELLED;
+			}
+		}
+		munmap(addr, window_size);
+	}
+	return FILE_SUCCESS;
+}
+
+/* ======================================================================== */
+/* DIRECT ENGINE                                                            */
+/* ======================================================================== */
+
+/*
+ * Drop everything up to the end of the given range from the page cache, after it has been read with buffered I/O;
+ * we always start at offset zero, because large folios that straddle the previous range could not be dropped before
+ */
+static inline void drop_cache(const int fd, const uint64_t offset, const size_t length)
+{
+#ifdef POSIX_FADV_DONTNEED
+	posix_fadvise(fd, 0, (off_t)(offset + length), POSIX_FADV_DONTNEED);
+#else
+	(void)fd; (void)offset; (void)length;
+#endif
+}
+
+/*
+ * Read the regular file through the large aligned buffers of the context. If io_uring is available, all buffers
+ * are in flight at the same time; otherwise, the buffers are filled by a separate reader thread. If the file could
+ * not be opened with O_DIRECT, we read with buffered I/O and drop the pages from the page cache right away. A short
+ * read (e.g. on NFS or FUSE) leaves the next offset unaligned, so O_DIRECT is turned off for the rest of the file.
+ */
+static file_status_t read_direct(const int fd, const uint64_t file_size, const bool direct, IOContext &context, MHash384 &mhash384, const ThreadPool *const pool)
+{
+	if(uring_t *const ring = context.uring())
+	{
+		uint8_t *buffers[PIPELINE_RING_SIZE];
+		for(size_t i = 0U; i < PIPELINE_RING_SIZE; ++i)
+		{
+			buffers[i] = context.ring_buffer(i);
+		}
+		const int error_code = uring_read_stream(ring, fd, file_size, buffers, PIPELINE_RING_SIZE, PIPELINE_BUFFER_SIZE, [&](const uint8_t *const data, const size_t length, const uint64_t offset)
+		{
+			if(!direct)
+			{
+				drop_cache(fd, offset, length);
+			}
+			{
+				PhaseTimer timer(PHASE_HASH, length);
+				mhash384.update(data, length);
+			}
+			return !is_cancelled(pool);
+		});
+		return error_code ? FILE_READ_ERROR : (is_cancelled(pool) ? FILE_CANCELLED : FILE_SUCCESS);
+	}
+
+	uint64_t position = 0U;
+	bool direct_io = direct;
+	return read_pipeline([fd, &direct_io, &position](uint8_t *const buffer, const size_t size) -> ptrdiff_t
+	{
+		ssize_t length;
+		do
+		{
+			length = pread(fd, buffer, size, (off_t)position);
+		}
+		while((length < 0) && (errno == EINTR));
+		if(length > 0)
+		{
+			if(!direct_io)
+			{
+				drop_cache(fd, position, (size_t)length);
+			}
+			position += (uint64_t)length;
+			if(direct_io && (position % PIPELINE_ALIGNMENT))
+			{
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT); /*short read, O_DIRECT can not continue at an unaligned offset*/
+				direct_io = false;
+			}
+		}
+		return (ptrdiff_t)length;
+	},
+	context, mhash384, pool);
+}
+
+#endif //HAVE_MMAP
+
+/* ======================================================================== */
+/* PUBLIC FUNCTIONS                                                         */
+/* ======================================================================== */
+
+/*
+ * Check whether the I/O engine is supported on this platform
+ */
+bool io_engine_available(const io_engine_t engine)
+{
+	switch(engine)
+	{
+	case IO_STDIO:
+	case IO_URING: /*falls back to stdio, if not supported by the kernel*/
+		return true;
+#ifdef HAVE_MMAP
+	case IO_MMAP:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+/*
+ * Open the input file and process its contents, using the selected I/O engine
+ */
+static file_status_t process_input(const CHAR_T *const file_name, IOContext &context, MHash384 &mhash384, int &error_code, const options_t &options, const ThreadPool *const pool)
+{
+	FILE *input = NULL;
+
+	/* Open the input file */
+	PhaseTimer open_timer(PHASE_OPEN);
+	errno = 0;
+#ifdef HAVE_MMAP
+	if(file_name && ((options.io_engine == IO_MMAP) || options.direct))
+	{
+		bool direct = options.direct && (O_DIRECT != 0);
+		int fd = open(file_name, O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+		if((fd < 0) && direct && (errno == EINVAL))
+		{
+			direct = false; /*O_DIRECT is not supported by the file system*/
+			fd = open(file_name, O_RDONLY | O_CLOEXEC);
+		}
+		if(fd < 0)
+		{
+			error_code = errno;
+			return FILE_OPEN_ERROR;
+		}
+		struct stat file_info;
+		if(!fstat(fd, &file_info))
+		{
+			if(S_ISDIR(file_info.st_mode))
+			{
+				close(fd);
+				return FILE_DIRECTORY;
+			}
+			if(S_ISREG(file_info.st_mode) && (file_info.st_size > 0))
+			{
+				open_timer.stop();
+				bool unmappable = false;
+				const file_status_t status = options.direct ? read_direct(fd, (uint64_t)file_info.st_size, direct, context, mhash384, pool) : read_mmap(fd, (uint64_t)file_info.st_size, mhash384, pool, unmappable);
+				if(!unmappable)
+				{
+					close(fd);
+					return status;
+				}
+			}
+		}
+		if(direct)
+		{
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT); /*stdio buffers are not aligned*/
+		}
+		if(!(input = fdopen(fd, "rb"))) /*not a regular file, or not mappable, fall back to stdio*/
+		{
+			error_code = errno;
+			close(fd);
+			return FILE_OPEN_ERROR;
+		}
+	}
+#endif
+	if(!input)
+	{
+		if(!(input = file_name ? FOPEN(file_name, STR("rb")) : stdin))
+		{
+			error_code = errno;
+			return FILE_OPEN_ERROR;
+		}
+
+		/* Check if file is directory (this is required for Linux!)*/
+		struct stat file_info;
+		if(!fstat(fileno(input), &file_info))
+		{
+			if((file_info.st_mode & S_IFMT) == S_IFDIR)
+			{
+				fclose(input);
+				return FILE_DIRECTORY;
+			}
+		}
+	}
+
+	/* Process complete input */
+	open_timer.stop();
+	const file_status_t status = options.pipeline ? read_pipeline([input](uint8_t *const buffer, const size_t size) -> ptrdiff_t
+	{
+		const size_t length = fread(buffer, sizeof(uint8_t), size, input);
+		return (length || (!ferror(input))) ? (ptrdiff_t)length : -1;
+	},
+	context, mhash384, pool) : read_stdio(input, context.buffer(), mhash384, pool);
+
+	/* Close the input file */
+	if(file_name)
+	{
+		fclose(input);
+	}
+
+	return status;
+}
+
+/*
+ * Hash the input file without consulting the digest cache
+ */
+static file_status_t hash_file_uncached(const CHAR_T *const file_name, IOContext &context, file_result_t &result, const options_t &options, const ThreadPool *const pool)
+{
+	if(options.tree)
+	{
+		return tree_hash_file(file_name, result, options, pool);
+	}
+	if(file_name && (options.io_engine == IO_URING) && (!options.direct) && context.uring())
+	{
+		uring_hash_files(context.uring(), &file_name, 1U, &result, pool, [](const size_t) {});
+		return result.status;
+	}
+	MHash384 mhash384;
+	if((result.status = process_input(file_name, context, mhash384, result.error_code, options, pool)) == FILE_SUCCESS)
+	{
+		memcpy(result.digest, mhash384.finish(), MHASH384_SIZE);
+	}
+	return result.status;
+}
+
+/*
+ * Look up the file in the digest cache; on a hit, the cached digest is stored in the result
+ */
+static cache_lookup_t cache_lookup(const CHAR_T *const file_name, file_result_t &result, cache_entry_t &key, uint8_t *const cached, const options_t &options)
+{
+	const cache_lookup_t lookup = (file_name && options.cache) ? options.cache->lookup(file_name, options.tree, key, cached) : CACHE_NONE;
+	if(lookup == CACHE_HIT)
+	{
+		memcpy(result.digest, cached, MHASH384_SIZE);
+		result.status = FILE_SUCCESS;
+	}
+	return lookup;
+}
+
+/*
+ * Update the digest cache with the digest that has just been computed; a verified hit that does not match the fresh
+ * digest is reported as a failure, and the cache is *not* updated in that case
+ */
+static void cache_update(const CHAR_T *const file_name, file_result_t &result, const cache_lookup_t lookup, const cache_entry_t &key, const uint8_t *const cached, const options_t &options)
+{
+	if(result.status != FILE_SUCCESS)
+	{
+		return;
+	}
+	if(lookup == CACHE_VERIFY)
+	{
+		if(memcmp(result.digest, cached, MHASH384_SIZE))
+		{
+			options.cache->count_mismatch();
+			result.status = FILE_CACHE_MISMATCH;
+		}
+	}
+	else if(lookup == CACHE_MISS)
+	{
+		options.cache->insert(file_name, key, result.digest);
+	}
+}
+
+/*
+ * Hash the input file, using the I/O buffers of the given context
+ */
+file_status_t hash_file(const CHAR_T *const file_name, IOContext &context, file_result_t &result, const options_t &options, const ThreadPool *const pool)
+{
+	cache_entry_t key;
+	uint8_t cached[MHASH384_SIZE];
+	const cache_lookup_t lookup = cache_lookup(file_name, result, key, cached, options);
+	if(lookup != CACHE_HIT)
+	{
+		FileTimer timer;
+		hash_file_uncached(file_name, context, result, options, pool);
+		timer.finish(result.status == FILE_SUCCESS);
+		cache_update(file_name, result, lookup, key, cached, options);
+	}
+	return result.status;
+}
+
+/*
+ * Hash a batch of files; the callback is invoked for each file, as soon as its result is available. With the io_uring
+ * engine, the files of the batch are in flight at the same time, so the results may become available in any order!
+ */
+void hash_files(const CHAR_T *const *const file_names, const size_t count, IOContext &context, file_result_t *const results, const options_t &options, const ThreadPool *const pool, const file_callback_t &callback)
+{
+	uring_t *const ring = ((options.io_engine == IO_URING) && (!options.direct) && (!options.tree)) ? context.uring() : NULL;
+	if(ring && options.cache)
+	{
+		/* Cache hits are completed right away, only the remaining files go to the ring */
+		std::vector<cache_entry_t> keys(count);
+		std::vector<std::array<uint8_t, MHASH384_SIZE>> cached(count);
+		std::vector<cache_lookup_t> lookups(count);
+		std::vector<const CHAR_T*> pending_names;
+		std::vector<size_t> pending;
+		for(size_t i = 0U; i < count; ++i)
+		{
+			if((lookups[i] = cache_lookup(file_names[i], results[i], keys[i], cached[i].data(), options)) == CACHE_HIT)
+			{
+				callback(i);
+				continue;
+			}
+			pending_names.push_back(file_names[i]);
+			pending.push_back(i);
+		}
+		if(!pending.empty())
+		{
+			FileTimer timer;
+			std::vector<file_result_t> pending_results(pending.size());
+			uring_hash_files(ring, pending_names.data(), pending.size(), pending_results.data(), pool, [&](const size_t index)
+			{
+				const size_t i = pending[index];
+				results[i] = pending_results[index];
+				cache_update(file_names[i], results[i], lookups[i], keys[i], cached[i].data(), options);
+				callback(i);
+			});
+			timer.finish(false); /*files are recorded individually*/
+		}
+	}
+	else if(ring)
+	{
+		FileTimer timer;
+		uring_hash_files(ring, file_names, count, results, pool, callback);
+		timer.finish(false); /*files are recorded individually*/
+	}
+	else
+	{
+		for(size_t i = 0U; i < count; ++i)
+		{
+			hash_file(file_names[i], context, results[i], options, pool);
+			callback(i);
+		}
+	}
+}
+
+/*
+ * Get the pipeline statistics
+ */
+void get_pipeline_stats(pipeline_stats_t &stats)
+{
+	stats.reader_ns = g_reader_stall_ns.load();
+	stats.hasher_ns = g_hasher_stall_ns.load();
+	stats.buffers = g_pipeline_buffers.load();
+}
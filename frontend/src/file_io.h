@@ -0,0 +1,108 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_FILE_IO_H
+#define INC_MHASH384_FILE_IO_H
+
+#include "common.h"
+#include "mhash384.h"
+#include <functional>
+
+class ThreadPool;
+typedef struct uring_t uring_t;
+
+/* Buffer sizes */
+static const size_t BUFFER_SIZE = 8192U;
+static const size_t PIPELINE_BUFFER_SIZE = 1U << 20;
+static const size_t PIPELINE_RING_SIZE = 4U;
+
+/* Maximum number of files that are passed to the io_uring engine at once */
+static const size_t URING_BATCH_SIZE = 64U;
+
+/* I/O engines */
+typedef enum
+{
+	IO_STDIO = 0,
+	IO_MMAP  = 1,
+	IO_URING = 2
+}
+io_engine_t;
+
+/* Result of processing a file */
+typedef enum
+{
+	FILE_SUCCESS        =  0,
+	FILE_OPEN_ERROR     =  1,
+	FILE_DIRECTORY      =  2,
+	FILE_READ_ERROR     =  3,
+	FILE_CANCELLED      =  4,
+	FILE_CACHE_MISMATCH =  5
+}
+file_status_t;
+
+typedef struct
+{
+	file_status_t status;
+	int error_code;
+	uint8_t digest[MHASH384_SIZE];
+}
+file_result_t;
+
+/* Callback that is invoked as soon as the result of a file is available */
+typedef std::function<void(const size_t index)> file_callback_t;
+
+/*
+ * Per-thread I/O buffers, allocated on first use and reused for all files processed by the thread
+ */
+class IOContext
+{
+public:
+	IOContext(void);
+	~IOContext(void);
+
+	uint8_t *buffer(void);
+	uint8_t *ring_buffer(const size_t index);
+	uring_t *uring(void);
+
+private:
+	IOContext(const IOContext&);
+	IOContext &operator=(const IOContext&);
+
+	uint8_t *m_buffer;
+	uint8_t *m_ring[PIPELINE_RING_SIZE];
+	uring_t *m_uring;
+	bool m_uring_failed;
+};
+
+/* Time spent stalled in pipeline mode, summed up over all files */
+typedef struct
+{
+	uint64_t reader_ns; /*reader waited for a free buffer*/
+	uint64_t hasher_ns; /*hasher waited for a filled buffer*/
+	uint64_t buffers;   /*number of buffers passed through the ring*/
+}
+pipeline_stats_t;
+
+bool io_engine_available(const io_engine_t engine);
+file_status_t hash_file(const CHAR_T *const file_name, IOContext &context, file_result_t &result, const options_t &options, const ThreadPool *const pool);
+void hash_files(const CHAR_T *const *const file_names, const size_t count, IOContext &context, file_result_t *const results, const options_t &options, const ThreadPool *const pool, const file_callback_t &callback);
+void get_pipeline_stats(pipeline_stats_t &stats);
+
+#endif /*INC_MHASH384_FILE_IO_H*/
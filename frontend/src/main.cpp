@@ -23,7 +23,16 @@
 #include "self_test.h"
 #include "utils.h"
 #include "sys_info.h"
-#include <ctime>
+#include "thread_pool.h"
+#include "file_io.h"
+#include "check.h"
+#include "dir_walker.h"
+#include "digest_cache.h"
+#include "spill_sorter.h"
+#include "phase_timer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
 #include <sys/stat.h>
 #include <errno.h>
 
@@ -44,9 +53,6 @@
 /* System type */
 #define SYSTEM_TYPE STR(SYSTEM_NAME) STR("-") STR(SYSTEM_ARCH)
 
-/* Buffer size */
-static const size_t BUFFER_SIZE = 8192U;
-
 /* Mode of operation */
 typedef enum
 {
@@ -55,6 +61,7 @@ typedef enum
 	MODE_VERSION  =  2,
 	MODE_SELFTEST =  3,
 	MODE_STRESS   =  4,
+	MODE_CHECK    =  5,
 	MODE_UNKNOWN  = -1
 }
 opmode_t;
@@ -81,6 +88,7 @@ static void print_version(void)
 	mhash384_version(&ver_major, &ver_minor, &ver_patch);
 	FPRINTF(stdout, STR("MHash-384 v%u.%02u-%u, ") SYSTEM_TYPE STR("\n"), ver_major, ver_minor, ver_patch);
 	FPRINTF(stdout, STR("Built on ") STR(__DATE__) STR(" at ") STR(__TIME__) STR(", using ") STR(COMPILER_FMT) STR("\n"), COMPILER_ARG);
+	FPRINTF(stdout, STR("Active kernel: %") PRI_char STR("\n"), mhash384_kernel());
 }
 
 /*
@@ -98,33 +106,76 @@ static void print_manpage(const CHAR_T *const argv0)
 	FPUTS(STR("   --lower-case  Print the digest in lower-case letters (default: upper-case)\n"), stderr);
 	FPUTS(STR("   --base64      Print the digest in Base64 format (default: Hex format)\n"), stderr);
 	FPUTS(STR("   --base85      Print the digest in Base85 format (default: Hex format)\n"), stderr);
+	FPUTS(STR("   --threads N   Process up to N files concurrently (default: number of CPUs)\n"), stderr);
+	FPUTS(STR("   --io=ENGINE   Select the I/O engine: \"stdio\" (default), \"mmap\" or \"uring\"\n"), stderr);
+	FPUTS(STR("   --pipeline    Read the input on a separate thread, overlapping reading and hashing\n"), stderr);
+	FPUTS(STR("   --direct      Read regular files with O_DIRECT, bypassing the page cache\n"), stderr);
+	FPUTS(STR("   --recursive   Process all files in the specified directories, recursively\n"), stderr);
+	FPUTS(STR("   --include=PAT Process only files whose name matches the glob pattern (recursive)\n"), stderr);
+	FPUTS(STR("   --exclude=PAT Skip files and directories whose name matches the pattern (recursive)\n"), stderr);
+	FPUTS(STR("   --sort        Print the results sorted by path (recursive, default: completion order)\n"), stderr);
+	FPUTS(STR("   --cache FILE  Keep the digests of unchanged files in the specified cache file\n"), stderr);
+	FPUTS(STR("   --cache-verify-ratio R  Re-hash a random fraction R of the cache hits (0.0 to 1.0)\n"), stderr);
+	FPUTS(STR("   --tree        Compute the parallel tree hash, which differs from the standard digest\n"), stderr);
 	FPUTS(STR("   --help        Print help screen and exit\n"), stderr);
 	FPUTS(STR("   --version     Print program version and exit\n"), stderr);
 	FPUTS(STR("   --self-test   Run self-test and exit\n"), stderr);
+	FPUTS(STR("   --quick       Skip the test vectors with very long inputs (self-test mode)\n"), stderr);
 	FPUTS(STR("   --stress      Enable stress test mode; strings are read from the input file\n"), stderr);
-	FPUTS(STR("   --benchmark   Measure the overall time required for the operation\n\n"), stderr);
+	FPUTS(STR("   --check       Verify the files listed in the input file(s) (\"<digest>  <file name>\")\n"), stderr);
+	FPUTS(STR("   --verbose     Print the digest of every test string (stress test mode)\n"), stderr);
+	FPUTS(STR("   --mem-limit N Spill the digests to sorted runs on disk, using up to N MiB (stress test mode)\n"), stderr);
+	FPUTS(STR("   --benchmark   Measure the time of the operation, per phase, and the throughput per file\n"), stderr);
+	FPUTS(STR("   --benchmark=json  Same as \"--benchmark\", but print the results in JSON format\n\n"), stderr);
 	FPUTS(STR("If *no* input file is specified, data is read from the standard input (stdin)\n"), stderr);
 }
 
 /*
  * Encode digest string
  */
-static std::string encode_digest(const uint8_t *const digest, const options_t &options)
+static const char *encode_digest(char (&buffer)[DIGEST_STRING_SIZE], const uint8_t *const digest, const options_t &options)
 {
-	if (options.base_enc)
+	if (options.base_enc > 1U)
+	{
+		bytes_to_base85(buffer, digest, MHASH384_SIZE);
+	}
+	else if (options.base_enc)
 	{
-		return ((options.base_enc > 1U) ? bytes_to_base85(digest, MHASH384_SIZE) : bytes_to_base64(digest, MHASH384_SIZE));
+		bytes_to_base64(buffer, digest, MHASH384_SIZE);
 	}
 	else
 	{
-		return bytes_to_hex(digest, MHASH384_SIZE, options.lower_case);
+		bytes_to_hex(buffer, digest, MHASH384_SIZE, options.lower_case);
+	}
+	return buffer;
+}
+
+/*
+ * Parse the name of an I/O engine
+ */
+static bool parse_io_engine(const CHAR_T *const name, int &io_engine)
+{
+	static const struct { const CHAR_T *name; io_engine_t engine; } IO_ENGINES[] =
+	{
+		{ STR("stdio"), IO_STDIO },
+		{ STR("mmap"),  IO_MMAP  },
+		{ STR("uring"), IO_URING },
+	};
+	for(size_t i = 0U; i < sizeof(IO_ENGINES) / sizeof(IO_ENGINES[0U]); ++i)
+	{
+		if((!STRICMP(name, IO_ENGINES[i].name)) && io_engine_available(IO_ENGINES[i].engine))
+		{
+			io_engine = IO_ENGINES[i].engine;
+			return true;
+		}
 	}
+	return false;
 }
 
 /*
  * Parse command-line options
  */
-static opmode_t parse_options(int &arg_offset, options_t &options, const int argc, const CHAR_T *const *const argv)
+static opmode_t parse_options(int &arg_offset, options_t &options, walk_filter_t &filter, const int argc, const CHAR_T *const *const argv)
 {
 	opmode_t mode = MODE_DEFAULT;
 	memset(&options, 0, sizeof(options_t));
@@ -157,6 +208,91 @@ static opmode_t parse_options(int &arg_offset, options_t &options, const int arg
 		{
 			options.lower_case = true;
 		}
+		else if((!STRNICMP(argstr, STR("io="), 3U)) && (parse_io_engine(argstr + 3U, options.io_engine)))
+		{
+			/*I/O engine has been selected*/
+		}
+		else if(!STRICMP(argstr, STR("pipeline")))
+		{
+			options.pipeline = true;
+		}
+		else if(!STRICMP(argstr, STR("direct")))
+		{
+			options.direct = true;
+		}
+		else if(!STRICMP(argstr, STR("recursive")))
+		{
+			options.recursive = true;
+		}
+		else if(!STRICMP(argstr, STR("sort")))
+		{
+			options.sorted = true;
+		}
+		else if(!STRICMP(argstr, STR("tree")))
+		{
+			options.tree = true;
+		}
+		else if((!STRNICMP(argstr, STR("include="), 8U)) && argstr[8U])
+		{
+			filter.include.push_back(argstr + 8U);
+		}
+		else if((!STRNICMP(argstr, STR("exclude="), 8U)) && argstr[8U])
+		{
+			filter.exclude.push_back(argstr + 8U);
+		}
+		else if(!STRICMP(argstr, STR("threads")))
+		{
+			CHAR_T *end_ptr = NULL;
+			const unsigned long value = (arg_offset + 1 < argc) ? STRTOUL(argv[arg_offset + 1], &end_ptr, 10) : 0UL;
+			if((!end_ptr) || (*end_ptr) || (value < 1UL) || (value > 1024UL))
+			{
+				print_logo();
+				FPUTS(STR("Error: Option \"--threads\" requires a number in the range from 1 to 1024!\n"), stderr);
+				fflush(stderr);
+				return MODE_UNKNOWN;
+			}
+			options.thread_count = (uint32_t)value;
+			++arg_offset;
+		}
+		else if(!STRICMP(argstr, STR("cache")))
+		{
+			if((arg_offset + 1 >= argc) || (!cache_available()))
+			{
+				print_logo();
+				FPUTS(cache_available() ? STR("Error: Option \"--cache\" requires a file name!\n") : STR("Error: Option \"--cache\" is not supported on this platform!\n"), stderr);
+				fflush(stderr);
+				return MODE_UNKNOWN;
+			}
+			options.cache_file = argv[++arg_offset];
+		}
+		else if(!STRICMP(argstr, STR("cache-verify-ratio")))
+		{
+			CHAR_T *end_ptr = NULL;
+			const double value = (arg_offset + 1 < argc) ? STRTOD(argv[arg_offset + 1], &end_ptr) : -1.0;
+			if((!end_ptr) || (*end_ptr) || (!(value >= 0.0)) || (value > 1.0))
+			{
+				print_logo();
+				FPUTS(STR("Error: Option \"--cache-verify-ratio\" requires a number in the range from 0.0 to 1.0!\n"), stderr);
+				fflush(stderr);
+				return MODE_UNKNOWN;
+			}
+			options.verify_ratio = value;
+			++arg_offset;
+		}
+		else if(!STRICMP(argstr, STR("mem-limit")))
+		{
+			CHAR_T *end_ptr = NULL;
+			const unsigned long value = (arg_offset + 1 < argc) ? STRTOUL(argv[arg_offset + 1], &end_ptr, 10) : 0UL;
+			if((!end_ptr) || (*end_ptr) || (value < 16UL) || (value > 1048576UL) || (!spill_available()))
+			{
+				print_logo();
+				FPUTS(spill_available() ? STR("Error: Option \"--mem-limit\" requires a number in the range from 16 to 1048576 (MiB)!\n") : STR("Error: Option \"--mem-limit\" is not supported on this platform!\n"), stderr);
+				fflush(stderr);
+				return MODE_UNKNOWN;
+			}
+			options.mem_limit = ((uint64_t)value) << 20;
+			++arg_offset;
+		}
 		else if(!STRICMP(argstr, STR("help")))
 		{
 			mode = MODE_MANPAGE;
@@ -169,14 +305,30 @@ static opmode_t parse_options(int &arg_offset, options_t &options, const int arg
 		{
 			mode = MODE_SELFTEST;
 		}
+		else if(!STRICMP(argstr, STR("quick")))
+		{
+			options.quick = true;
+		}
 		else if(!STRICMP(argstr, STR("stress")))
 		{
 			mode = MODE_STRESS;
 		}
+		else if(!STRICMP(argstr, STR("check")))
+		{
+			mode = MODE_CHECK;
+		}
 		else if(!STRICMP(argstr, STR("benchmark")))
 		{
 			options.benchmark = true;
 		}
+		else if(!STRICMP(argstr, STR("benchmark=json")))
+		{
+			options.benchmark = options.benchmark_json = true;
+		}
+		else if(!STRICMP(argstr, STR("verbose")))
+		{
+			options.verbose = true;
+		}
 		else
 		{
 			print_logo();
@@ -188,6 +340,11 @@ static opmode_t parse_options(int &arg_offset, options_t &options, const int arg
 		++arg_offset;
 	}
 
+	if (!options.thread_count)
+	{
+		options.thread_count = (uint32_t)get_cpu_count();
+	}
+
 	if (options.base_enc > 2)
 	{
 		print_logo();
@@ -202,80 +359,232 @@ static opmode_t parse_options(int &arg_offset, options_t &options, const int arg
 		fflush(stderr);
 		return MODE_UNKNOWN;
 	}
+	else if (options.tree && options.recursive)
+	{
+		print_logo();
+		FPUTS(STR("Error: Options \"--tree\" and \"--recursive\" are mutually exclusive!\n"), stderr);
+		fflush(stderr);
+		return MODE_UNKNOWN;
+	}
 
 	return mode;
 }
 
 /*
- * Process input file
+ * Print the digest or the error message
  */
-static bool process_file(const CHAR_T *const file_name, const options_t options)
+static bool print_result(const CHAR_T *const file_name, const file_result_t &result, const options_t &options)
 {
-	/* File description */
 	const CHAR_T *const file_description = file_name ? file_name : STR("<STDIN>");
-
-	/* Open the input file */
-	errno = 0;
-	FILE *const input = file_name ? FOPEN(file_name, STR("rb")) : stdin;
-	if(!input)
+	PhaseTimer timer(PHASE_OUTPUT);
+	switch(result.status)
 	{
-		FPRINTF(stderr, STR("Error: File \"%") PRI_CHAR STR("\" could not be opened for reading! [errno: %d]\n"), file_description, errno);
-		fflush(stderr);
-		return false;
+	case FILE_SUCCESS:
+		{
+			const CHAR_T *const source_name = file_name ? file_name : STR("-");
+			const CHAR_T *const format = options.short_format ? STR("%") PRI_char STR("\n") : STR("%") PRI_char STR("  %") PRI_CHAR STR("\n");
+			char digest_string[DIGEST_STRING_SIZE];
+			FPRINTF(stdout, format, encode_digest(digest_string, result.digest, options), source_name);
+			fflush(stdout);
+		}
+		return true;
+	case FILE_OPEN_ERROR:
+		FPRINTF(stderr, STR("Error: File \"%") PRI_CHAR STR("\" could not be opened for reading! [errno: %d]\n"), file_description, result.error_code);
+		break;
+	case FILE_DIRECTORY:
+		FPRINTF(stderr, STR("Error: File \"%") PRI_CHAR STR("\" is a directory!\n"), file_description);
+		break;
+	case FILE_READ_ERROR:
+		FPRINTF(stderr, STR("Error: File \"%") PRI_CHAR STR("\" encountered an I/O error!\n"), file_description);
+		break;
+	case FILE_CACHE_MISMATCH:
+		FPRINTF(stderr, STR("Error: File \"%") PRI_CHAR STR("\" does not match its cached digest, although it is unchanged!\n"), file_description);
+		break;
+	default:
+		break;
 	}
+	fflush(stderr);
+	return false;
+}
+
+/*
+ * Process input file
+ */
+static bool process_file(const CHAR_T *const file_name, const options_t &options)
+{
+	IOContext context;
+	file_result_t result;
+	hash_file(file_name, context, result, options, NULL);
+	return print_result(file_name, result, options);
+}
+
+/* Handler for the result of a file, returns false if the file has failed */
+typedef std::function<bool(const CHAR_T *const file_name, const file_result_t &result)> result_handler_t;
+
+/*
+ * Process multiple input files concurrently; the results are passed to the handler in the original order
+ */
+static bool process_files(const CHAR_T *const *const file_names, const size_t count, const options_t &options, const result_handler_t &handler)
+{
+	bool success = false;
+	const size_t batch_size = ((options.io_engine == IO_URING) && (!options.direct) && (!options.tree)) ? std::max(std::min((count + options.thread_count - 1U) / options.thread_count, URING_BATCH_SIZE), (size_t)1U) : 1U;
+	const size_t task_count = (count + batch_size - 1U) / batch_size;
+	ThreadPool pool(options.tree ? 1U : std::min(task_count, (size_t)options.thread_count)); /*tree mode uses all threads per file*/
+	std::vector<IOContext> contexts(pool.thread_count());
+	std::vector<file_result_t> results(count);
+	std::vector<char> completed(count, 0);
+	std::mutex mutex;
+	std::condition_variable cond;
+
+	pool.start(task_count, [&](const size_t worker_id, const size_t task_id)
+	{
+		const size_t offset = task_id * batch_size;
+		hash_files(file_names + offset, std::min(batch_size, count - offset), contexts[worker_id], results.data() + offset, options, &pool, [&](const size_t index)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			completed[offset + index] = 1;
+			cond.notify_all();
+		});
+	});
 
-	/* Check if file is directory (this is required for Linux!)*/
-	struct stat file_info;
-	if(!fstat(fileno(input), &file_info))
+	for(size_t i = 0U; i < count; ++i)
 	{
-		if((file_info.st_mode & S_IFMT) == S_IFDIR)
 		{
-			FPRINTF(stderr, STR("Error: File \"%") PRI_CHAR STR("\" is a directory!\n"), file_description);
-			fclose(input);
-			fflush(stderr);
-			return false;
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [&]() { return completed[i] != 0; });
+		}
+		if(handler(file_names[i], results[i]))
+		{
+			success = true;
+		}
+		else if(!options.keep_going)
+		{
+			pool.cancel();
+			success = false;
+			break;
 		}
 	}
 
-	/* Initialize hash state */
-	MHash384 mhash384;
-	uint8_t buffer[BUFFER_SIZE];
-	bool success = true;
+	pool.wait();
+	return success;
+}
 
-	/* Process complete input */
-	for(;;)
+/*
+ * Process all files in the given directories recursively; the files are hashed as soon as they have been found
+ */
+static bool process_tree(const CHAR_T *const *const paths, const size_t count, const options_t &options, const walk_filter_t &filter)
+{
+	typedef std::pair<DirWalker::path_t, file_result_t> entry_t;
+	ThreadPool pool(options.thread_count);
+	std::vector<IOContext> contexts(pool.thread_count());
+	std::vector<entry_t> entries;
+	std::mutex mutex;
+	bool any_success = false, failed = false;
+
+	DirWalker walker(pool, filter);
+	walker.run(paths, count, [&](const size_t worker_id, const DirWalker::path_t &path)
 	{
-		const size_t length = fread(buffer, sizeof(uint8_t), BUFFER_SIZE, input);
-		if(!length)
+		file_result_t result;
+		hash_file(path.c_str(), contexts[worker_id], result, options, &pool);
+		std::lock_guard<std::mutex> lock(mutex);
+		if(options.sorted)
 		{
-			break; /*EOF or error*/
+			entries.push_back(entry_t(path, result)); /*printed later*/
+		}
+		else if(print_result(path.c_str(), result, options))
+		{
+			any_success = true;
+			return;
+		}
+		if((result.status != FILE_SUCCESS) && (result.status != FILE_CANCELLED))
+		{
+			failed = true;
+			if(!options.keep_going)
+			{
+				pool.cancel();
+			}
+		}
+	},
+	[&](const DirWalker::path_t &path, const int error_code)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		FPRINTF(stderr, STR("Error: Directory \"%") PRI_CHAR STR("\" could not be read! [errno: %d]\n"), path.c_str(), error_code);
+		fflush(stderr);
+		failed = true;
+		if(!options.keep_going)
+		{
+			pool.cancel();
+		}
+	});
+
+	if(options.sorted)
+	{
+		std::sort(entries.begin(), entries.end(), [](const entry_t &a, const entry_t &b) { return a.first < b.first; });
+		for(std::vector<entry_t>::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+		{
+			if(print_result(iter->first.c_str(), iter->second, options))
+			{
+				any_success = true;
+			}
+			else if(!options.keep_going)
+			{
+				break;
+			}
 		}
-		mhash384.update(buffer, length);
 	}
 
-	/* Print the final digest */
-	if(!ferror(input))
+	return failed ? (options.keep_going && any_success) : true;
+}
+
+/*
+ * Verify the files listed in the checksum file concurrently; stops at the first failure, unless "--keep-going"
+ */
+static bool check_files(const CHAR_T *const check_file, const options_t &options)
+{
+	std::vector<check_entry_t> entries;
+	size_t malformed = 0U;
+	if(!read_check_file(check_file, entries, malformed))
 	{
-		const uint8_t *const digest = mhash384.finish();
-		const CHAR_T *const source_name = file_name ? file_name : STR("-");
-		const CHAR_T *const format = options.short_format ? STR("%") PRI_char STR("\n") : STR("%") PRI_char STR("  %") PRI_CHAR STR("\n");
-		FPRINTF(stdout, format, encode_digest(digest, options).c_str(), source_name);
-		fflush(stdout);
+		FPRINTF(stderr, STR("Error: Checksum file \"%") PRI_CHAR STR("\" could not be read! [errno: %d]\n"), check_file ? check_file : STR("<STDIN>"), errno);
+		fflush(stderr);
+		return false;
 	}
-	else
+	if(entries.empty())
 	{
-		FPRINTF(stderr, STR("Error: File \"%") PRI_CHAR STR("\" encountered an I/O error!\n"), file_description);
+		FPRINTF(stderr, STR("Error: Checksum file \"%") PRI_CHAR STR("\" contains no properly formatted lines!\n"), check_file ? check_file : STR("<STDIN>"));
 		fflush(stderr);
-		success = false;
+		return false;
 	}
 
-	/* Close the input file */
-	if(file_name)
+	std::vector<const CHAR_T*> file_names(entries.size());
+	for(size_t i = 0U; i < entries.size(); ++i)
 	{
-		fclose(input);
+		file_names[i] = entries[i].file_name.c_str();
 	}
 
-	return success;
+	size_t index = 0U, passed = 0U, mismatch = 0U, failed = 0U;
+	process_files(file_names.data(), file_names.size(), options, [&](const CHAR_T *const file_name, const file_result_t &result)
+	{
+		const check_entry_t &entry = entries[index++];
+		if(result.status != FILE_SUCCESS)
+		{
+			++failed;
+			return print_result(file_name, result, options);
+		}
+		const bool match = !memcmp(result.digest, entry.digest, MHASH384_SIZE);
+		PhaseTimer timer(PHASE_OUTPUT);
+		FPRINTF(stdout, STR("%") PRI_CHAR STR(": %") PRI_CHAR STR("\n"), file_name, match ? STR("OK") : STR("FAILED"));
+		fflush(stdout);
+		++(match ? passed : mismatch);
+		return match;
+	});
+
+	FPRINTF(stderr, STR("Checked %") STR(PRIu64) STR(" of %") STR(PRIu64) STR(" file(s): %") STR(PRIu64) STR(" OK, %") STR(PRIu64) STR(" FAILED, %") STR(PRIu64) STR(" unreadable"),
+		(uint64_t)index, (uint64_t)entries.size(), (uint64_t)passed, (uint64_t)mismatch, (uint64_t)failed);
+	FPRINTF(stderr, malformed ? STR(", %") STR(PRIu64) STR(" line(s) improperly formatted.\n") : STR(".\n"), (uint64_t)malformed);
+	fflush(stderr);
+
+	return (passed == entries.size()) && (!malformed);
 }
 
 /*
@@ -294,14 +603,35 @@ static int mhash384_main(int argc, CHAR_T* argv[])
 	
 	/* Parse all command-line options */
 	options_t options;
-	const opmode_t mode = parse_options(arg_offset, options, argc, argv);
+	walk_filter_t filter;
+	const opmode_t mode = parse_options(arg_offset, options, filter, argc, argv);
 	if(mode == MODE_UNKNOWN)
 	{
 		return EXIT_FAILURE;
 	}
 
+	/* Open the digest cache */
+	std::unique_ptr<DigestCache> cache;
+	if(options.cache_file && ((mode == MODE_DEFAULT) || (mode == MODE_CHECK)))
+	{
+		int error_code = 0;
+		cache.reset(new DigestCache(options.verify_ratio));
+		if(!cache->open(options.cache_file, error_code))
+		{
+			FPRINTF(stderr, STR("Error: Cache file \"%") PRI_CHAR STR("\" could not be opened! [errno: %d]\n"), options.cache_file, error_code);
+			fflush(stderr);
+			return EXIT_FAILURE;
+		}
+		options.cache = cache.get();
+	}
+
 	/* Remember startup time */
-	const clock_t time_start = options.benchmark ? clock() : 0U;
+	const time_sample_t time_start = phase_time_now();
+	const uint64_t cpu_start = process_cpu_ns();
+	if(options.benchmark)
+	{
+		phase_stats_enable();
+	}
 
 	/* Select mode of operation */
 	switch(mode)
@@ -330,9 +660,43 @@ static int mhash384_main(int argc, CHAR_T* argv[])
 		success = stress_test((arg_offset < argc) ? argv[arg_offset] : NULL, options);
 		break;
 
+	case MODE_CHECK:
+		/* Verify the files listed in each checksum file */
+		if(arg_offset < argc)
+		{
+			success = true;
+			while(arg_offset < argc)
+			{
+				if(!check_files(argv[arg_offset++], options))
+				{
+					success = false;
+					if(!options.keep_going)
+					{
+						break;
+					}
+				}
+			}
+		}
+		else
+		{
+			success = check_files(NULL, options); /*stdin*/
+		}
+		break;
+
 	default:
 		/* Process all input files */
-		if(arg_offset < argc)
+		if(options.recursive && (arg_offset < argc))
+		{
+			success = process_tree(argv + arg_offset, (size_t)(argc - arg_offset), options, filter);
+		}
+		else if((argc - arg_offset > 1) && ((options.thread_count > 1U) || (options.io_engine == IO_URING)))
+		{
+			success = process_files(argv + arg_offset, (size_t)(argc - arg_offset), options, [&](const CHAR_T *const file_name, const file_result_t &result)
+			{
+				return print_result(file_name, result, options);
+			});
+		}
+		else if(arg_offset < argc)
 		{
 			while(arg_offset < argc)
 			{
@@ -354,10 +718,27 @@ static int mhash384_main(int argc, CHAR_T* argv[])
 	}
 
 	/* Print total time */
-	if(options.benchmark && ((mode == MODE_DEFAULT) || ((mode >= MODE_SELFTEST) && (mode <= MODE_STRESS))))
+	if(options.benchmark && ((mode == MODE_DEFAULT) || ((mode >= MODE_SELFTEST) && (mode <= MODE_CHECK))))
+	{
+		print_phase_stats(time_start, cpu_start, options.benchmark_json);
+		if(options.pipeline && ((mode == MODE_DEFAULT) || (mode == MODE_CHECK)))
+		{
+			pipeline_stats_t stats;
+			get_pipeline_stats(stats);
+			FPRINTF(stderr, STR("Pipeline: %") STR(PRIu64) STR(" buffer(s), reader stalled %.3f second(s), hasher stalled %.3f second(s).\n"), stats.buffers, stats.reader_ns / 1e9, stats.hasher_ns / 1e9);
+		}
+		if(cache)
+		{
+			cache_stats_t stats;
+			cache->get_stats(stats);
+			FPRINTF(stderr, STR("Cache: %") STR(PRIu64) STR(" hit(s), %") STR(PRIu64) STR(" miss(es), %") STR(PRIu64) STR(" hit(s) verified, %") STR(PRIu64) STR(" mismatch(es).\n"), stats.hits, stats.misses, stats.verified, stats.mismatches);
+		}
+	}
+
+	/* Write the new cache entries */
+	if(cache)
 	{
-		const clock_t total_time = clock() - time_start;
-		FPRINTF(stderr, STR("Operation took %.1f second(s).\n"), total_time / ((double)CLOCKS_PER_SEC));
+		cache->close();
 	}
 
 	/* Completed */
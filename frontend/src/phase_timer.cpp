@@ -0,0 +1,296 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "phase_timer.h"
+#include "mhash384.h"
+
+#include <ctime>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#endif
+
+/* Names of the phases */
+static const CHAR_T *const PHASE_NAME[PHASE_COUNT] = { STR("open"), STR("read"), STR("hash"), STR("output") };
+
+/* Phase totals, summed up over all threads */
+static bool g_enabled = false;
+static std::atomic<uint64_t> g_wall_ns[PHASE_COUNT], g_cpu_ns[PHASE_COUNT], g_bytes;
+
+/* Per-file throughput records: number of bytes and wall-clock time */
+static std::mutex g_files_mutex;
+static std::vector<std::pair<uint64_t,uint64_t>> g_files;
+
+/* Phase totals of the calling thread, used to derive the "read" phase of a file */
+typedef struct
+{
+	uint64_t wall_ns[PHASE_COUNT];
+	uint64_t cpu_ns[PHASE_COUNT];
+	uint64_t bytes;
+}
+thread_phases_t;
+
+static thread_local thread_phases_t t_phases;
+
+/* ======================================================================== */
+/* CLOCKS                                                                   */
+/* ======================================================================== */
+
+#ifdef _WIN32
+static inline uint64_t filetime_to_ns(const FILETIME &time)
+{
+	return ((((uint64_t)time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100U;
+}
+#endif
+
+/*
+ * Get the monotonic wall-clock time and the CPU time of the calling thread
+ */
+time_sample_t phase_time_now(void)
+{
+	time_sample_t sample;
+	sample.wall_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#ifdef _WIN32
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	sample.cpu_ns = GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time) ? (filetime_to_ns(kernel_time) + filetime_to_ns(user_time)) : 0U;
+#else
+	struct timespec cpu_time;
+	sample.cpu_ns = (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time)) ? (((uint64_t)cpu_time.tv_sec) * 1000000000U + (uint64_t)cpu_time.tv_nsec) : 0U;
+#endif
+	return sample;
+}
+
+/*
+ * Get the CPU time of the whole process, i.e. of all threads
+ */
+uint64_t process_cpu_ns(void)
+{
+#ifdef _WIN32
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	return GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time) ? (filetime_to_ns(kernel_time) + filetime_to_ns(user_time)) : 0U;
+#else
+	struct timespec cpu_time;
+	return (!clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time)) ? (((uint64_t)cpu_time.tv_sec) * 1000000000U + (uint64_t)cpu_time.tv_nsec) : 0U;
+#endif
+}
+
+/* ======================================================================== */
+/* TIMERS                                                                   */
+/* ======================================================================== */
+
+/*
+ * Enable the phase statistics; must be called before any other threads are started
+ */
+void phase_stats_enable(void)
+{
+	g_enabled = true;
+	mhash384_stats_reset();
+}
+
+PhaseTimer::PhaseTimer(const phase_t phase, const uint64_t bytes)
+:
+	m_phase(phase),
+	m_bytes(bytes),
+	m_running(g_enabled)
+{
+	if(m_running)
+	{
+		m_start = phase_time_now();
+	}
+}
+
+void PhaseTimer::stop(void)
+{
+	if(m_running)
+	{
+		m_running = false;
+		const time_sample_t now = phase_time_now();
+		const uint64_t wall_ns = now.wall_ns - m_start.wall_ns, cpu_ns = now.cpu_ns - m_start.cpu_ns;
+		t_phases.wall_ns[m_phase] += wall_ns;
+		t_phases.cpu_ns[m_phase] += cpu_ns;
+		t_phases.bytes += m_bytes;
+		g_wall_ns[m_phase] += wall_ns;
+		g_cpu_ns[m_phase] += cpu_ns;
+		if(m_bytes)
+		{
+			g_bytes += m_bytes;
+		}
+	}
+}
+
+FileTimer::FileTimer(void)
+:
+	m_running(g_enabled)
+{
+	if(m_running)
+	{
+		memcpy(m_wall_ns, t_phases.wall_ns, sizeof(m_wall_ns));
+		memcpy(m_cpu_ns, t_phases.cpu_ns, sizeof(m_cpu_ns));
+		m_bytes = t_phases.bytes;
+		m_start = phase_time_now();
+	}
+}
+
+void FileTimer::finish(const bool record_file)
+{
+	if(!m_running)
+	{
+		return;
+	}
+	m_running = false;
+	const time_sample_t now = phase_time_now();
+	uint64_t wall_ns = now.wall_ns - m_start.wall_ns, cpu_ns = now.cpu_ns - m_start.cpu_ns;
+	for(size_t phase = 0U; phase < PHASE_COUNT; ++phase)
+	{
+		if(phase != PHASE_READ)
+		{
+			wall_ns -= std::min(wall_ns, t_phases.wall_ns[phase] - m_wall_ns[phase]);
+			cpu_ns -= std::min(cpu_ns, t_phases.cpu_ns[phase] - m_cpu_ns[phase]);
+		}
+	}
+	g_wall_ns[PHASE_READ] += wall_ns;
+	g_cpu_ns[PHASE_READ] += cpu_ns;
+	if(record_file)
+	{
+		phase_record_file(t_phases.bytes - m_bytes, now.wall_ns - m_start.wall_ns);
+	}
+}
+
+/*
+ * Attribute bytes that have been hashed on other threads (e.g. tree mode) to the current file of the calling thread
+ */
+void phase_count_bytes(const uint64_t bytes)
+{
+	if(g_enabled)
+	{
+		t_phases.bytes += bytes;
+		g_bytes += bytes;
+	}
+}
+
+/*
+ * Record the throughput of a single file; files without any hashed data are ignored
+ */
+void phase_record_file(const uint64_t bytes, const uint64_t wall_ns)
+{
+	if(g_enabled && bytes)
+	{
+		std::lock_guard<std::mutex> lock(g_files_mutex);
+		g_files.push_back(std::make_pair(bytes, wall_ns));
+	}
+}
+
+/* ======================================================================== */
+/* OUTPUT                                                                   */
+/* ======================================================================== */
+
+/*
+ * Nearest-rank percentile of the sorted values
+ */
+static double percentile(const std::vector<double> &sorted, const double p)
+{
+	if(sorted.empty())
+	{
+		return 0.0;
+	}
+	const size_t rank = (size_t)std::ceil(p * sorted.size());
+	return sorted[(rank > 0U) ? std::min(rank - 1U, sorted.size() - 1U) : 0U];
+}
+
+/*
+ * Print the total time, the time of each phase (summed up over all threads) and the per-file throughput
+ */
+void print_phase_stats(const time_sample_t &start, const uint64_t start_cpu_ns, const bool json)
+{
+	const double wall_time = (phase_time_now().wall_ns - start.wall_ns) / 1e9, cpu_time = (process_cpu_ns() - start_cpu_ns) / 1e9;
+
+	std::vector<double> throughput;
+	{
+		std::lock_guard<std::mutex> lock(g_files_mutex);
+		for(std::vector<std::pair<uint64_t,uint64_t>>::const_iterator iter = g_files.begin(); iter != g_files.end(); ++iter)
+		{
+			throughput.push_back((iter->first / 1e6) / std::max(iter->second / 1e9, 1e-9));
+		}
+	}
+	std::sort(throughput.begin(), throughput.end());
+	const double overall = (wall_time > 0.0) ? ((g_bytes.load() / 1e6) / wall_time) : 0.0;
+
+	mhash384_stats_t library;
+	const bool have_library = mhash384_stats_get(&library);
+
+	if(json)
+	{
+		FPRINTF(stderr, STR("{ \"wall_s\": %.6f, \"cpu_s\": %.6f, \"phases\": { "), wall_time, cpu_time);
+		for(size_t phase = 0U; phase < PHASE_COUNT; ++phase)
+		{
+			FPRINTF(stderr, STR("\"%") PRI_CHAR STR("\": { \"wall_s\": %.6f, \"cpu_s\": %.6f }%") PRI_CHAR, PHASE_NAME[phase], g_wall_ns[phase].load() / 1e9, g_cpu_ns[phase].load() / 1e9, (phase + 1U < PHASE_COUNT) ? STR(", ") : STR(" }, "));
+		}
+		FPRINTF(stderr, STR("\"files\": %") STR(PRIu64) STR(", \"bytes\": %") STR(PRIu64) STR(", \"mb_per_s\": { \"overall\": %.3f, \"min\": %.3f, \"median\": %.3f, \"p99\": %.3f }"),
+			(uint64_t)throughput.size(), g_bytes.load(), overall, percentile(throughput, 0.0), percentile(throughput, 0.5), percentile(throughput, 0.99));
+		if(have_library)
+		{
+			FPRINTF(stderr, STR(", \"library\": { \"bytes\": %") STR(PRIu64) STR(", \"update_calls\": %") STR(PRIu64) STR(", \"final_calls\": %") STR(PRIu64) STR(", \"update_sizes\": ["),
+				library.bytes, library.update_calls, library.final_calls);
+			for(size_t bucket = 0U; bucket < MHASH384_STATS_BUCKETS; ++bucket)
+			{
+				FPRINTF(stderr, STR("%") PRI_CHAR STR("%") STR(PRIu64), bucket ? STR(", ") : STR(" "), library.update_sizes[bucket]);
+			}
+			FPUTS(STR(" ] }"), stderr);
+		}
+		FPUTS(STR(" }\n"), stderr);
+	}
+	else
+	{
+		FPRINTF(stderr, STR("Operation took %.3f second(s) wall-clock, %.3f second(s) CPU.\n"), wall_time, cpu_time);
+		if(g_bytes.load() || (g_wall_ns[PHASE_OPEN].load() > 0U))
+		{
+			FPUTS(STR("Phases (wall-clock/CPU, summed up over all threads):"), stderr);
+			for(size_t phase = 0U; phase < PHASE_COUNT; ++phase)
+			{
+				FPRINTF(stderr, STR(" %") PRI_CHAR STR(" %.3f/%.3f s%") PRI_CHAR, PHASE_NAME[phase], g_wall_ns[phase].load() / 1e9, g_cpu_ns[phase].load() / 1e9, (phase + 1U < PHASE_COUNT) ? STR(",") : STR(".\n"));
+			}
+			FPRINTF(stderr, STR("Throughput: %.1f MB/s overall, %") STR(PRIu64) STR(" file(s) hashed; per file: min %.1f, median %.1f, p99 %.1f MB/s.\n"),
+				overall, (uint64_t)throughput.size(), percentile(throughput, 0.0), percentile(throughput, 0.5), percentile(throughput, 0.99));
+		}
+		if(have_library)
+		{
+			FPRINTF(stderr, STR("Library: %") STR(PRIu64) STR(" byte(s), %") STR(PRIu64) STR(" update call(s), %") STR(PRIu64) STR(" digest(s)"),
+				library.bytes, library.update_calls, library.final_calls);
+			for(size_t bucket = 0U, first = 1U; bucket < MHASH384_STATS_BUCKETS; ++bucket)
+			{
+				if(library.update_sizes[bucket])
+				{
+					const bool last = (bucket + 1U >= MHASH384_STATS_BUCKETS);
+					FPRINTF(stderr, STR("%") PRI_CHAR STR("%") PRI_CHAR STR("%") STR(PRIu64) STR(": %") STR(PRIu64), first ? STR("; update sizes: ") : STR(", "),
+						last ? STR(">=") : STR("<"), UINT64_C(1) << (last ? (bucket - 1U) : bucket), library.update_sizes[bucket]);
+					first = 0U;
+				}
+			}
+			FPUTS(STR(".\n"), stderr);
+		}
+	}
+}
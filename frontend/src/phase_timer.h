@@ -0,0 +1,93 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_PHASE_TIMER_H
+#define INC_MHASH384_PHASE_TIMER_H
+
+#include "common.h"
+
+/* Phases of processing a file */
+typedef enum
+{
+	PHASE_OPEN   = 0,  /*open and stat*/
+	PHASE_READ   = 1,  /*reading, including the time spent waiting for I/O*/
+	PHASE_HASH   = 2,
+	PHASE_OUTPUT = 3,
+	PHASE_COUNT  = 4
+}
+phase_t;
+
+/* Point in time: monotonic wall-clock time, plus CPU time of the calling thread */
+typedef struct
+{
+	uint64_t wall_ns;
+	uint64_t cpu_ns;
+}
+time_sample_t;
+
+/*
+ * Measures a single phase on the calling thread, from construction until stop() or destruction; does nothing, unless
+ * the phase statistics have been enabled. The number of bytes is attributed to the current file.
+ */
+class PhaseTimer
+{
+public:
+	PhaseTimer(const phase_t phase, const uint64_t bytes = 0U);
+	~PhaseTimer(void) { stop(); }
+	void stop(void);
+
+private:
+	PhaseTimer(const PhaseTimer&);
+	PhaseTimer &operator=(const PhaseTimer&);
+
+	const phase_t m_phase;
+	const uint64_t m_bytes;
+	bool m_running;
+	time_sample_t m_start;
+};
+
+/*
+ * Measures a whole file (or a batch of files) on the calling thread; the time that has not been spent in the "open",
+ * "hash" or "output" phase on this thread is attributed to the "read" phase. Optionally, the throughput of the file
+ * is recorded, if any data has been hashed.
+ */
+class FileTimer
+{
+public:
+	FileTimer(void);
+	void finish(const bool record_file);
+
+private:
+	FileTimer(const FileTimer&);
+	FileTimer &operator=(const FileTimer&);
+
+	bool m_running;
+	time_sample_t m_start;
+	uint64_t m_wall_ns[PHASE_COUNT], m_cpu_ns[PHASE_COUNT], m_bytes;
+};
+
+void phase_stats_enable(void);
+time_sample_t phase_time_now(void);
+uint64_t process_cpu_ns(void);
+void phase_count_bytes(const uint64_t bytes);
+void phase_record_file(const uint64_t bytes, const uint64_t wall_ns);
+void print_phase_stats(const time_sample_t &start, const uint64_t start_cpu_ns, const bool json);
+
+#endif /*INC_MHASH384_PHASE_TIMER_H*/
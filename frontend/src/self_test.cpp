@@ -21,13 +21,28 @@
 #include "self_test.h"
 #include "utils.h"
 #include "mhash384.h"
+#include "thread_pool.h"
+#include "digest_set.h"
+#include "spill_sorter.h"
 
 #include <cstring>
-#include <unordered_set>
 #include <array>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 #include <errno.h>
 
+/* Number of lines per batch, and number of batches per worker thread that are read in one window */
+static const size_t STRESS_BATCH_SIZE = 4096U;
+static const size_t STRESS_WINDOW_BATCHES = 4U;
+
+/* Test vectors with more input bytes than this are skipped by the "--quick" profile */
+static const uint64_t SELFTEST_QUICK_LIMIT = 16777216U;
+
 /*
  * Test-case specification
  */
@@ -78,56 +93,66 @@ static const uint8_t SELFTEST_EXPECTED[][MHASH384_SIZE] =
 };
 
 /*
- * Hash function helper class for std::unordered_set
+ * Tree mode test-cases: empty input, a short leaf, exactly one leaf, and inputs that end with a partial leaf; the
+ * input repeats the given pattern
  */
-struct KeyHasher
+static const char *const SELFTEST_TREE_PATTERN = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno";
+
+static const uint64_t SELFTEST_TREE_LENGTH[] =
 {
-	std::size_t operator()(const std::array<std::uint8_t,MHASH384_SIZE> &key) const
-	{
-		if(key.size() >= sizeof(std::size_t))
-		{
-			return *reinterpret_cast<const size_t*>(key.data());
-		}
-		else if(key.size() >= sizeof(uint32_t))
-		{
-			return *reinterpret_cast<const uint32_t*>(key.data());
-		}
-		else if(key.size() >= sizeof(uint16_t))
-		{
-			return *reinterpret_cast<const uint16_t*>(key.data());
-		}
-		else
-		{
-			return (key.size() > 0U) ? key[0U] : 0U;
-		}
-	}
+	0U, 3U, MHASH384_TREE_LEAF_SIZE, (3U * MHASH384_TREE_LEAF_SIZE) + 1U, (4U * MHASH384_TREE_LEAF_SIZE) + 1U
 };
 
 /*
- * Comparison function helper class for std::unordered_set
+ * Expected tree hash values
  */
-struct KeyEqualTo
+static const uint8_t SELFTEST_TREE_EXPECTED[][MHASH384_SIZE] =
 {
-	bool operator()(const std::array<std::uint8_t,MHASH384_SIZE> &a, const std::array<std::uint8_t,MHASH384_SIZE> &b) const
-	{
-		if (a.size() == b.size())
-		{
-			return (memcmp(a.data(), b.data(), a.size()) == 0);
-		}
-		return false;
-	}
+	{ 0x4B, 0xFF, 0x87, 0x21, 0x8A, 0x96, 0x40, 0xC3, 0xC2, 0x5D, 0xFC, 0xC5, 0x96, 0x95, 0x69, 0xDB, 0xAD, 0xF1, 0x1E, 0xC8, 0x94, 0x43, 0xF2, 0x81, 0x89, 0xC5, 0x38, 0x9D, 0xBB, 0x57, 0x22, 0x41, 0xDF, 0x41, 0x51, 0xA9, 0x90, 0x5D, 0xCA, 0xC1, 0x6C, 0x4A, 0x2F, 0xAE, 0x60, 0xB2, 0x2F, 0x19 },
+	{ 0x19, 0x68, 0xB2, 0x8D, 0x09, 0xC2, 0xE0, 0x1C, 0xC2, 0x70, 0xA3, 0x47, 0xF6, 0xA0, 0xC6, 0x8D, 0xA4, 0x44, 0xB5, 0xF9, 0xC2, 0xD3, 0x8B, 0xF0, 0x30, 0x03, 0xA1, 0x47, 0x6A, 0x62, 0xFC, 0xE2, 0x40, 0x71, 0xD4, 0xA6, 0xDE, 0xC5, 0x5E, 0xDD, 0xFF, 0x17, 0xCE, 0x30, 0x6C, 0x86, 0x34, 0xAC },
+	{ 0xB1, 0xD3, 0xF6, 0x1C, 0x14, 0x83, 0xD1, 0x7A, 0x9A, 0x6F, 0x35, 0x2A, 0xEB, 0x44, 0x01, 0x88, 0x9B, 0xBD, 0x46, 0x74, 0x0B, 0xFC, 0x53, 0x1A, 0x7E, 0xE8, 0x36, 0xA3, 0x00, 0xE6, 0x33, 0x44, 0x73, 0x72, 0x6C, 0x75, 0xF1, 0xE1, 0xEB, 0x14, 0x45, 0xBA, 0xC6, 0x09, 0xEE, 0x2A, 0x90, 0x87 },
+	{ 0xC3, 0x43, 0x63, 0x3F, 0x50, 0x62, 0x70, 0xB3, 0x1C, 0x20, 0x52, 0x7F, 0xD4, 0x14, 0x18, 0x04, 0x49, 0x85, 0xDE, 0x9A, 0xAF, 0x8D, 0xCD, 0x91, 0x4C, 0x2D, 0x30, 0xB0, 0x3D, 0xC6, 0xF3, 0xCC, 0x53, 0x11, 0xF7, 0x4F, 0x8E, 0xDE, 0x1B, 0xEC, 0xFA, 0x6E, 0x93, 0x73, 0x59, 0x9D, 0xCA, 0xA4 },
+	{ 0x4D, 0xD2, 0x4B, 0xC5, 0x49, 0x64, 0x23, 0x28, 0x54, 0x57, 0x73, 0x4F, 0x4D, 0x05, 0x60, 0xE0, 0xED, 0xD8, 0xCA, 0x07, 0x94, 0xB7, 0x5A, 0xBE, 0x64, 0xB9, 0xD8, 0x0B, 0xE2, 0x67, 0xC3, 0x53, 0xD9, 0x0E, 0x6B, 0x7E, 0x1B, 0xCE, 0xA6, 0xA0, 0x0C, 0xEC, 0xE0, 0xC4, 0x54, 0x71, 0x3A, 0xF7 }
 };
 
 /*
- * Unordered set of hash values
+ * Batch of input lines; the lines are stored back to back, each one terminated by a NUL character
+ */
+typedef struct
+{
+	std::vector<char> text;
+	std::vector<size_t> offset;
+	std::vector<uint64_t> position; /*position of each line in the input file*/
+}
+line_batch_t;
+
+/*
+ * Per-thread state of the stress test
  */
-typedef std::unordered_set<std::array<std::uint8_t,MHASH384_SIZE>, KeyHasher, KeyEqualTo> UnorderedHashSet;
-typedef UnorderedHashSet::iterator HashSetIter;
+typedef struct
+{
+	std::vector<std::array<uint64_t,256U>> stats;
+	std::vector<const uint8_t*> data;
+	std::vector<size_t> length;
+	std::vector<std::array<uint8_t,MHASH384_SIZE>> digests;
+}
+stress_worker_t;
 
 /*
- * Read the next input line
+ * The first collision (in input order) of the stress test, unless all collisions are printed
  */
-static bool read_line(FILE *const input, char *const line, const int max_count, bool &flag)
+typedef struct
+{
+	bool found;
+	uint64_t position;
+	std::string line;
+}
+first_collision_t;
+
+/*
+ * Read the next input line; the current position in the input file is updated, and the position of the line is returned
+ */
+static bool read_line(FILE *const input, char *const line, const int max_count, bool &flag, uint64_t &position, uint64_t &line_position)
 {
 	for(;;)
 	{
@@ -136,6 +161,8 @@ static bool read_line(FILE *const input, char *const line, const int max_count,
 		if(fgets(line, max_count, input) != NULL)
 		{
 			size_t len = strlen(line);
+			line_position = position;
+			position += len;
 			while((len > 0) && (line[len - 1U] == '\n'))
 			{
 				flag = false; /*line not truncated*/
@@ -156,60 +183,331 @@ static bool read_line(FILE *const input, char *const line, const int max_count,
 /*
  * Encode digest string
  */
-static std::string encode_digest(const uint8_t *const digest, const options_t &options)
+static const char *encode_digest(char (&buffer)[DIGEST_STRING_SIZE], const uint8_t *const digest, const options_t &options)
 {
-	if (options.base_enc)
+	if (options.base_enc > 1U)
 	{
-		return ((options.base_enc > 1U) ? bytes_to_base85(digest, MHASH384_SIZE) : bytes_to_base64(digest, MHASH384_SIZE));
+		bytes_to_base85(buffer, digest, MHASH384_SIZE);
+	}
+	else if (options.base_enc)
+	{
+		bytes_to_base64(buffer, digest, MHASH384_SIZE);
 	}
 	else
 	{
-		return bytes_to_hex(digest, MHASH384_SIZE, options.lower_case);
+		bytes_to_hex(buffer, digest, MHASH384_SIZE, options.lower_case);
 	}
+	return buffer;
 }
 
 /*
- * Compute hash and compare against reference
+ * Kind and result of a single self-test task
  */
-static bool test_string(const uint32_t count, const char *const text, const uint8_t *const expected, const options_t &options)
+typedef enum
+{
+	SELFTEST_LIBRARY,
+	SELFTEST_VECTOR,
+	SELFTEST_TREE,
+	SELFTEST_BATCH
+}
+selftest_kind_t;
+
+typedef enum
+{
+	SELFTEST_PENDING,
+	SELFTEST_PASSED,
+	SELFTEST_FAILED,
+	SELFTEST_SKIPPED
+}
+selftest_status_t;
+
+typedef struct
 {
-	MHash384 mhash384;
+	selftest_kind_t kind;
+	size_t index;
+	uint64_t cost;
+	selftest_status_t status;
+	uint8_t digest[MHASH384_SIZE];
+}
+selftest_result_t;
+
+/*
+ * Compute hash and compare against reference; gives up early, if the pool has been cancelled
+ */
+static selftest_status_t test_string(const uint32_t count, const char *const text, const uint8_t *const expected, uint8_t *const digest_out, const ThreadPool &pool)
+{
+	const size_t len = strlen(text);
+	mhash384_t ctx;
+	mhash384_init(&ctx);
 	for(uint32_t i = 0U; i < count; ++i)
 	{
-		mhash384.update(text);
+		if((!(i & 0xFFFFU)) && pool.cancelled())
+		{
+			return SELFTEST_PENDING;
+		}
+		mhash384_update(&ctx, reinterpret_cast<const uint8_t*>(text), len);
 	}
 
-	const uint8_t *const digest = mhash384.finish();
-	const bool success = (!memcmp(digest, expected, MHASH384_SIZE));
+	mhash384_final(&ctx, digest_out);
+	return memcmp(digest_out, expected, MHASH384_SIZE) ? SELFTEST_FAILED : SELFTEST_PASSED;
+}
 
-	FPRINTF(stderr, STR("%") PRI_char STR(" - %") PRI_CHAR STR("\n"), encode_digest(digest, options).c_str(), success ? STR("OK") : STR("Error!"));
-	
+/*
+ * Compute tree hash of the repeated pattern and compare against reference
+ */
+static selftest_status_t test_tree(const uint64_t length, const uint8_t *const expected, uint8_t *const digest_out)
+{
+	const size_t pattern_len = strlen(SELFTEST_TREE_PATTERN);
+	std::vector<uint8_t> data((size_t)length);
+	for(size_t i = 0U; i < data.size(); ++i)
+	{
+		data[i] = (uint8_t)SELFTEST_TREE_PATTERN[i % pattern_len];
+	}
+
+	mhash384_tree_compute(digest_out, data.data(), data.size());
+	return memcmp(digest_out, expected, MHASH384_SIZE) ? SELFTEST_FAILED : SELFTEST_PASSED;
+}
+
+/*
+ * Compute the test vectors (except for the very long ones) and messages of mixed lengths with the multi-buffer
+ * functions, and compare against the expected resp. the single-stream hash values; the lengths are chosen so that
+ * the lanes finish in different rounds and are refilled at different times
+ */
+static selftest_status_t test_batch(void)
+{
+	std::vector<std::vector<uint8_t>> messages;
+	std::vector<std::array<uint8_t,MHASH384_SIZE>> expected;
+	for(size_t i = 0U; SELFTEST_INPUT[i].count > 0U; ++i)
+	{
+		const size_t len = strlen(SELFTEST_INPUT[i].string);
+		if(SELFTEST_INPUT[i].count * (uint64_t)len <= SELFTEST_QUICK_LIMIT)
+		{
+			messages.emplace_back();
+			for(uint32_t j = 0U; j < SELFTEST_INPUT[i].count; ++j)
+			{
+				messages.back().insert(messages.back().end(), SELFTEST_INPUT[i].string, SELFTEST_INPUT[i].string + len);
+			}
+			expected.emplace_back();
+			memcpy(expected.back().data(), SELFTEST_EXPECTED[i], MHASH384_SIZE);
+		}
+	}
+	for(size_t i = 0U; i < 100U; ++i)
+	{
+		messages.emplace_back(((i * i * 31U) + (i * 7U)) % 2600U);
+		for(size_t j = 0U; j < messages.back().size(); ++j)
+		{
+			messages.back()[j] = (uint8_t)((i * 131U) + (j * 17U) + (j >> 7));
+		}
+		expected.emplace_back();
+		mhash384_compute(expected.back().data(), messages.back().data(), messages.back().size());
+	}
+
+	/* Batch function */
+	std::vector<const uint8_t*> data(messages.size());
+	std::vector<size_t> length(messages.size());
+	std::vector<std::array<uint8_t,MHASH384_SIZE>> digests(messages.size());
+	for(size_t i = 0U; i < messages.size(); ++i)
+	{
+		data[i] = messages[i].data();
+		length[i] = messages[i].size();
+	}
+	mhash384_compute_batch(reinterpret_cast<uint8_t(*)[MHASH384_SIZE]>(digests.data()), data.data(), length.data(), messages.size());
+	for(size_t i = 0U; i < messages.size(); ++i)
+	{
+		if(memcmp(digests[i].data(), expected[i].data(), MHASH384_SIZE))
+		{
+			return SELFTEST_FAILED;
+		}
+	}
+
+	/* Multi-buffer functions, with eight messages of the same length, fed in chunks of different sizes */
+	static const size_t CHUNK_SIZE[] = { 0U, 1U, 63U, 64U, 1000U, 872U };
+	std::vector<std::vector<uint8_t>> lanes(MHASH384_LANES, std::vector<uint8_t>(2000U));
+	const uint8_t *input[MHASH384_LANES];
+	uint8_t *output[MHASH384_LANES];
+	for(size_t lane = 0U; lane < MHASH384_LANES; ++lane)
+	{
+		for(size_t j = 0U; j < lanes[lane].size(); ++j)
+		{
+			lanes[lane][j] = (uint8_t)((lane * 59U) + (j * 13U) + (j >> 5));
+		}
+		input[lane] = lanes[lane].data();
+		output[lane] = digests[lane].data();
+	}
+	mhash384_x8_t ctx;
+	mhash384_init_x8(&ctx);
+	for(size_t i = 0U; i < sizeof(CHUNK_SIZE) / sizeof(CHUNK_SIZE[0U]); ++i)
+	{
+		mhash384_update_x8(&ctx, input, CHUNK_SIZE[i]);
+		for(size_t lane = 0U; lane < MHASH384_LANES; ++lane)
+		{
+			input[lane] += CHUNK_SIZE[i];
+		}
+	}
+	mhash384_final_x8(&ctx, output);
+	for(size_t lane = 0U; lane < MHASH384_LANES; ++lane)
+	{
+		uint8_t reference[MHASH384_SIZE];
+		mhash384_compute(reference, lanes[lane].data(), lanes[lane].size());
+		if(memcmp(output[lane], reference, MHASH384_SIZE))
+		{
+			return SELFTEST_FAILED;
+		}
+	}
+
+	return SELFTEST_PASSED;
+}
+
+/*
+ * Print the results that are complete, in the original order; the library self-test and the multi-buffer test only
+ * have a line, if they failed
+ */
+static bool print_results(std::vector<selftest_result_t> &results, size_t &next, const options_t &options)
+{
+	bool success = true;
+	for(; (next < results.size()) && (results[next].status != SELFTEST_PENDING); ++next)
+	{
+		const selftest_result_t &result = results[next];
+		if((result.kind == SELFTEST_LIBRARY) || (result.kind == SELFTEST_BATCH))
+		{
+			if(result.status == SELFTEST_FAILED)
+			{
+				FPUTS((result.kind == SELFTEST_LIBRARY) ? STR("mhash384_selftest() - Error!\n") : STR("mhash384_compute_batch() - Error!\n"), stderr);
+			}
+		}
+		else
+		{
+			const CHAR_T *const status = (result.status == SELFTEST_PASSED) ? STR("OK") : ((result.status == SELFTEST_SKIPPED) ? STR("Skipped") : STR("Error!"));
+			char digest_string[DIGEST_STRING_SIZE];
+			FPRINTF(stderr, STR("%") PRI_char STR(" - %") PRI_CHAR STR("%") PRI_CHAR STR("\n"), encode_digest(digest_string, result.digest, options), status, (result.kind == SELFTEST_TREE) ? STR(" (tree)") : STR(""));
+		}
+		if(result.status == SELFTEST_FAILED)
+		{
+			success = false;
+			if(!options.keep_going)
+			{
+				next = results.size(); /*suppress the remaining results*/
+				break;
+			}
+		}
+	}
 	fflush(stderr);
 	return success;
 }
 
 /*
- * Compute hash and append to hashset
+ * Hash a batch of lines at once, and append the hash values to the hashset (or to the spill runs); returns the number of collisions
  */
-static bool append_string(UnorderedHashSet &hash_set, std::vector<std::array<uint64_t,256U>> &stats, const char *const text, const options_t &options)
+static size_t append_batch(ShardedDigestSet *const hash_set, SpillSorter *const spill, const size_t worker_id, stress_worker_t &worker, const line_batch_t &batch, std::mutex &output_mutex, first_collision_t &first_collision, const options_t &options)
 {
-	std::array<uint8_t, MHASH384_SIZE> digest;
-	mhash384_compute(digest.data(), reinterpret_cast<const uint8_t*>(text), strlen(text));
+	const size_t count = batch.offset.size();
+	worker.data.resize(count);
+	worker.length.resize(count);
+	worker.digests.resize(count);
+	for(size_t i = 0U; i < count; ++i)
+	{
+		worker.data[i] = reinterpret_cast<const uint8_t*>(batch.text.data() + batch.offset[i]);
+		worker.length[i] = strlen(batch.text.data() + batch.offset[i]);
+	}
+	mhash384_compute_batch(reinterpret_cast<uint8_t(*)[MHASH384_SIZE]>(worker.digests.data()), worker.data.data(), worker.length.data(), count);
 
-	FPRINTF(stderr, STR("%") PRI_char STR("\n"), encode_digest(digest.data(), options).c_str());
-	for(size_t i = 0U; i < MHASH384_SIZE; ++i)
+	size_t collisions = 0U;
+	for(size_t i = 0U; i < count; ++i)
 	{
-		stats[i][digest[i]]++;
+		const std::array<uint8_t, MHASH384_SIZE> &digest = worker.digests[i];
+		for(size_t j = 0U; j < MHASH384_SIZE; ++j)
+		{
+			worker.stats[j][digest[j]]++;
+		}
+		if(spill)
+		{
+			spill->append(worker_id, digest.data(), batch.position[i]); /*collisions are detected in the merge phase*/
+		}
+		else if(!hash_set->insert(digest.data()))
+		{
+			std::lock_guard<std::mutex> lock(output_mutex);
+			if(options.keep_going)
+			{
+				FPRINTF(stderr, STR("Collision detected: \"%") PRI_char STR("\"\n"), batch.text.data() + batch.offset[i]);
+				fflush(stderr);
+			}
+			else if((!first_collision.found) || (batch.position[i] < first_collision.position))
+			{
+				first_collision.found = true; /*batches are processed concurrently, keep the first collision only*/
+				first_collision.position = batch.position[i];
+				first_collision.line = batch.text.data() + batch.offset[i];
+			}
+			++collisions;
+		}
 	}
 
-	std::pair<HashSetIter, bool> result = hash_set.insert(digest);
-	if(!result.second)
+	if(options.verbose)
 	{
-		FPRINTF(stderr, STR("Collision detected: \"%") PRI_char STR("\"\n"), text);
+		std::lock_guard<std::mutex> lock(output_mutex);
+		char digest_string[DIGEST_STRING_SIZE];
+		for(size_t i = 0U; i < count; ++i)
+		{
+			FPRINTF(stderr, STR("%") PRI_char STR("\n"), encode_digest(digest_string, worker.digests[i].data(), options));
+		}
+		fflush(stderr);
+	}
+
+	return collisions;
+}
+
+/*
+ * Read the next batches of lines from the input file; returns the number of batches that have been filled
+ */
+static size_t read_batches(FILE *const input, std::vector<line_batch_t> &batches, bool &flag, uint64_t &position)
+{
+	char line[1024U];
+	uint64_t line_position = 0U;
+	size_t filled = 0U;
+	for(std::vector<line_batch_t>::iterator iter = batches.begin(); iter != batches.end(); ++iter)
+	{
+		iter->text.clear();
+		iter->offset.clear();
+		iter->position.clear();
+		while((iter->offset.size() < STRESS_BATCH_SIZE) && read_line(input, line, 1024U, flag, position, line_position))
+		{
+			if(line[0U])
+			{
+				iter->offset.push_back(iter->text.size());
+				iter->position.push_back(line_position);
+				iter->text.insert(iter->text.end(), line, line + strlen(line) + 1U);
+			}
+		}
+		if(iter->offset.empty())
+		{
+			break; /*EOF or error*/
+		}
+		++filled;
+	}
+	return filled;
+}
+
+/*
+ * Print the lines that caused a collision, in the order of their position; the lines are read from the input file
+ * again, if it is seekable, otherwise only the positions are printed
+ */
+static void print_spilled_collisions(FILE *const input, std::vector<std::pair<uint64_t,uint64_t>> &collisions)
+{
+	std::sort(collisions.begin(), collisions.end());
+	char line[1024U];
+	for(std::vector<std::pair<uint64_t,uint64_t>>::const_iterator iter = collisions.begin(); iter != collisions.end(); ++iter)
+	{
+		bool flag = false;
+		uint64_t position = iter->first, line_position = 0U;
+#if !defined(_WIN32)
+		if((!fseeko(input, (off_t)position, SEEK_SET)) && read_line(input, line, 1024U, flag, position, line_position))
+		{
+			FPRINTF(stderr, STR("Collision detected: \"%") PRI_char STR("\" [offset %") STR(PRIu64) STR(", first seen at offset %") STR(PRIu64) STR("]\n"), line, iter->first, iter->second);
+			continue;
+		}
+#endif
+		FPRINTF(stderr, STR("Collision detected: line at offset %") STR(PRIu64) STR(" equals line at offset %") STR(PRIu64) STR("\n"), iter->first, iter->second);
 	}
-	
 	fflush(stderr);
-	return result.second;
 }
 
 /*
@@ -217,21 +515,84 @@ static bool append_string(UnorderedHashSet &hash_set, std::vector<std::array<uin
  */
 bool self_test(const options_t &options)
 {
-	bool success = (mhash384_selftest() != 0);
-	if(success)
+	/* The library self-test comes first, followed by the test vectors, the tree mode test-cases and the multi-buffer test */
+	std::vector<selftest_result_t> results;
+	const auto add_task = [&results](const selftest_kind_t kind, const size_t index, const uint64_t cost)
+	{
+		results.emplace_back();
+		results.back().kind = kind;
+		results.back().index = index;
+		results.back().cost = cost;
+		results.back().status = SELFTEST_PENDING;
+	};
+	add_task(SELFTEST_LIBRARY, 0U, 2U * 257U * 257U * MHASH384_SIZE);
+	for(size_t i = 0U; SELFTEST_INPUT[i].count > 0U; ++i)
 	{
-		for(size_t i = 0U; SELFTEST_INPUT[i].count > 0U; ++i)
+		add_task(SELFTEST_VECTOR, i, SELFTEST_INPUT[i].count * (uint64_t)strlen(SELFTEST_INPUT[i].string));
+	}
+	for(size_t i = 0U; i < sizeof(SELFTEST_TREE_LENGTH) / sizeof(SELFTEST_TREE_LENGTH[0U]); ++i)
+	{
+		add_task(SELFTEST_TREE, i, SELFTEST_TREE_LENGTH[i]);
+	}
+	add_task(SELFTEST_BATCH, 0U, SELFTEST_QUICK_LIMIT);
+
+	/* Longest tasks are started first */
+	std::vector<size_t> order(results.size());
+	for(size_t i = 0U; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&results](const size_t a, const size_t b) { return results[a].cost > results[b].cost; });
+
+	std::mutex output_mutex;
+	bool success = true;
+	size_t next = 0U;
+	ThreadPool pool(std::min(order.size(), (size_t)options.thread_count));
+	pool.start(order.size(), [&](const size_t, const size_t task_id)
+	{
+		const size_t index = order[task_id];
+		const selftest_result_t &task = results[index];
+		selftest_status_t status;
+		uint8_t digest[MHASH384_SIZE] = { 0U };
+		switch(task.kind)
 		{
-			if(!test_string(SELFTEST_INPUT[i].count, SELFTEST_INPUT[i].string, SELFTEST_EXPECTED[i], options))
+		case SELFTEST_LIBRARY:
+			status = mhash384_selftest() ? SELFTEST_PASSED : SELFTEST_FAILED;
+			break;
+		case SELFTEST_VECTOR:
+			if(options.quick && (task.cost > SELFTEST_QUICK_LIMIT))
+			{
+				memcpy(digest, SELFTEST_EXPECTED[task.index], MHASH384_SIZE);
+				status = SELFTEST_SKIPPED;
+			}
+			else
+			{
+				status = test_string(SELFTEST_INPUT[task.index].count, SELFTEST_INPUT[task.index].string, SELFTEST_EXPECTED[task.index], digest, pool);
+			}
+			break;
+		case SELFTEST_TREE:
+			status = test_tree(SELFTEST_TREE_LENGTH[task.index], SELFTEST_TREE_EXPECTED[task.index], digest);
+			break;
+		default:
+			status = test_batch();
+			break;
+		}
+		if(status != SELFTEST_PENDING)
+		{
+			std::lock_guard<std::mutex> lock(output_mutex);
+			results[index].status = status;
+			memcpy(results[index].digest, digest, MHASH384_SIZE);
+			if(!print_results(results, next, options))
 			{
 				success = false;
 				if(!options.keep_going)
 				{
-					break; /*failure*/
+					pool.cancel();
 				}
 			}
 		}
-	}
+	});
+	pool.wait();
 
 	if(success)
 	{
@@ -246,7 +607,9 @@ bool self_test(const options_t &options)
 }
 
 /*
- * Stress-testing routine
+ * Stress-testing routine; the calling thread reads the input in windows of line batches, while the worker threads
+ * hash the batches of the previous window and insert the hash values into a sharded set; with "--mem-limit", the hash
+ * values are spilled to sorted runs on disk instead, which are merged after the input has been read completely
  */
 bool stress_test(const CHAR_T *const file_name, const options_t &options)
 {
@@ -258,32 +621,120 @@ bool stress_test(const CHAR_T *const file_name, const options_t &options)
 		return false;
 	}
 
-	std::vector<std::array<uint64_t,256U>> stats(MHASH384_SIZE);
-	for(size_t i = 0U; i < MHASH384_SIZE; ++i)
+	ThreadPool pool(options.thread_count);
+	const size_t window = pool.thread_count() * STRESS_WINDOW_BATCHES;
+	std::vector<line_batch_t> batches[2U] = { std::vector<line_batch_t>(window), std::vector<line_batch_t>(window) };
+	std::vector<stress_worker_t> workers(pool.thread_count());
+	for(std::vector<stress_worker_t>::iterator iter = workers.begin(); iter != workers.end(); ++iter)
 	{
-		stats[i].fill(0U);
+		iter->stats.resize(MHASH384_SIZE);
+		for(size_t i = 0U; i < MHASH384_SIZE; ++i)
+		{
+			iter->stats[i].fill(0U);
+		}
 	}
 
-	UnorderedHashSet hash_set;
-	char line[1024U];
-	bool success = true, flag = false;
+	std::unique_ptr<SpillSorter> spill;
+	if(options.mem_limit)
+	{
+		int error_code = 0;
+		spill.reset(new SpillSorter(pool.thread_count(), options.mem_limit));
+		if(!spill->open(error_code))
+		{
+			FPRINTF(stderr, STR("Error: Failed to create the temporary file! [errno: %d]\n"), error_code);
+			if(file_name)
+			{
+				fclose(input);
+			}
+			return false;
+		}
+	}
 
-	while(read_line(input, line, 1024U, flag))
+	std::unique_ptr<ShardedDigestSet> hash_set;
+	if(!spill)
 	{
-		/*FPRINTF(stderr, STR("\"%") PRI_char STR("\"\n"), line);*/
-		if(line[0U])
+		hash_set.reset(new ShardedDigestSet());
+	}
+
+	std::mutex output_mutex;
+	first_collision_t first_collision = { false, 0U, std::string() };
+	std::atomic<size_t> collisions(0U);
+	uint64_t position = 0U;
+	bool flag = false;
+
+	size_t current = 0U, filled = read_batches(input, batches[current], flag, position);
+	while(filled > 0U)
+	{
+		const std::vector<line_batch_t> &window_batches = batches[current];
+		pool.start(filled, [&](const size_t worker_id, const size_t task_id)
 		{
-			if(!append_string(hash_set, stats, line, options))
+			const size_t count = append_batch(hash_set.get(), spill.get(), worker_id, workers[worker_id], window_batches[task_id], output_mutex, first_collision, options);
+			if(count > 0U)
 			{
-				success = false;
+				collisions += count;
 				if(!options.keep_going)
 				{
-					break; /*collison*/
+					pool.cancel(); /*collision*/
 				}
 			}
+		});
+		current ^= 1U;
+		filled = (filled == window) ? read_batches(input, batches[current], flag, position) : 0U;
+		pool.wait();
+		if((collisions.load() && (!options.keep_going)) || (spill && spill->failed()) || (hash_set && hash_set->failed()))
+		{
+			break;
+		}
+	}
+
+	if(first_collision.found)
+	{
+		FPRINTF(stderr, STR("Collision detected: \"%") PRI_char STR("\"\n"), first_collision.line.c_str());
+		fflush(stderr);
+	}
+
+	const bool read_error = (ferror(input) != 0);
+	bool temp_error = hash_set && hash_set->failed();
+	uint64_t total = hash_set ? hash_set->size() : 0U;
+
+	if(spill)
+	{
+		std::vector<std::pair<uint64_t,uint64_t>> spilled;
+		temp_error = !(spill->flush() && spill->merge(pool, [&](const spill_record_t &original, const spill_record_t &duplicate)
+		{
+			std::lock_guard<std::mutex> lock(output_mutex);
+			if(options.keep_going || spilled.empty())
+			{
+				spilled.push_back(std::make_pair(duplicate.position, original.position));
+			}
+			else if(duplicate.position < spilled.front().first)
+			{
+				spilled.front() = std::make_pair(duplicate.position, original.position); /*keep the first collision only*/
+			}
+			++collisions;
+		}));
+		if(!temp_error)
+		{
+			print_spilled_collisions(input, spilled);
 		}
+		total = spill->record_count() - collisions.load();
 	}
 
+	std::vector<std::array<uint64_t,256U>> stats(MHASH384_SIZE);
+	for(size_t i = 0U; i < MHASH384_SIZE; ++i)
+	{
+		stats[i].fill(0U);
+		for(std::vector<stress_worker_t>::const_iterator iter = workers.begin(); iter != workers.end(); ++iter)
+		{
+			for(size_t j = 0U; j < 256U; ++j)
+			{
+				stats[i][j] += iter->stats[i][j];
+			}
+		}
+	}
+
+	bool success = (collisions.load() == 0U) && (!temp_error);
+
 	FPUTS(STR("\n[STATS]\n"), stderr);
 	for(size_t i = 0U; i < MHASH384_SIZE; ++i)
 	{
@@ -299,11 +750,26 @@ bool stress_test(const CHAR_T *const file_name, const options_t &options)
 		FPUTS(((i % 3U) == 2U) ? STR("\n") : STR("  "), stderr);
 	}
 
-	if(success)
+	if(options.benchmark && spill)
+	{
+		FPRINTF(stderr, STR("\nSpill: %") STR(PRIu64) STR(" run(s), merged in %") STR(PRIu64) STR(" pass(es), %.1f MiB in temporary file, memory limit %.1f MiB\n"),
+			(uint64_t)spill->run_count(), (uint64_t)spill->merge_passes(), spill->file_size() / 1048576.0, options.mem_limit / 1048576.0);
+	}
+	else if(options.benchmark)
+	{
+		const uint64_t memory = hash_set->memory_usage();
+		FPRINTF(stderr, STR("\nDigest set: %.1f MiB in memory, %.1f byte(s) per digest%") PRI_CHAR STR("\n"), memory / 1048576.0, total ? memory / (double)total : 0.0, hash_set->file_backed() ? STR(", full digests in temporary file") : STR(""));
+	}
+
+	if(temp_error)
+	{
+		FPUTS(STR("\nError: Failed to access the temporary file!\n"), stderr);
+	}
+	else if(success)
 	{
-		if(!ferror(input))
+		if(!read_error)
 		{
-			FPRINTF(stderr, STR("\nStress-test completed successfully. [%") STR(PRIu64) STR("]\n"), static_cast<uint64_t>(hash_set.size()));
+			FPRINTF(stderr, STR("\nStress-test completed successfully. [%") STR(PRIu64) STR("]\n"), total);
 		}
 		else
 		{
@@ -313,7 +779,7 @@ bool stress_test(const CHAR_T *const file_name, const options_t &options)
 	}
 	else
 	{
-		FPRINTF(stderr, STR("\nStress-test ended *with* collision! [%") STR(PRIu64) STR("]\n"), static_cast<uint64_t>(hash_set.size()));
+		FPRINTF(stderr, STR("\nStress-test ended *with* collision! [%") STR(PRIu64) STR("]\n"), total);
 	}
 	
 	if(file_name)
@@ -0,0 +1,490 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "spill_sorter.h"
+#include "thread_pool.h"
+
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <queue>
+#include <errno.h>
+
+/* POSIX stuff */
+#if !defined(_WIN32)
+#define HAVE_SPILL 1
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+/* Minimum number of records per run buffer */
+static const size_t SPILL_MIN_RUN = 1024U;
+
+/*
+ * Order of the records: by digest first, then by position
+ */
+static inline int compare_records(const spill_record_t &lhs, const spill_record_t &rhs)
+{
+	const int result = memcmp(lhs.digest, rhs.digest, MHASH384_SIZE);
+	if(result)
+	{
+		return result;
+	}
+	return (lhs.position < rhs.position) ? (-1) : ((lhs.position > rhs.position) ? 1 : 0);
+}
+
+/*
+ * Check whether the spill mode is supported on this platform
+ */
+bool spill_available(void)
+{
+#ifdef HAVE_SPILL
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* ======================================================================== */
+/* TEMPORARY FILE I/O                                                       */
+/* ======================================================================== */
+
+#ifdef HAVE_SPILL
+
+static bool write_fully(const int fd, const void *const data, const size_t size, const uint64_t offset)
+{
+	size_t total = 0U;
+	while(total < size)
+	{
+		const ssize_t count = pwrite(fd, reinterpret_cast<const uint8_t*>(data) + total, size - total, (off_t)(offset + total));
+		if(count <= 0)
+		{
+			if((count < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+			return false;
+		}
+		total += (size_t)count;
+	}
+	return true;
+}
+
+static bool read_fully(const int fd, void *const data, const size_t size, const uint64_t offset)
+{
+	size_t total = 0U;
+	while(total < size)
+	{
+		const ssize_t count = pread(fd, reinterpret_cast<uint8_t*>(data) + total, size - total, (off_t)(offset + total));
+		if(count <= 0)
+		{
+			if((count < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+			return false;
+		}
+		total += (size_t)count;
+	}
+	return true;
+}
+
+#endif /*HAVE_SPILL*/
+
+/* ======================================================================== */
+/* RUN MERGING                                                              */
+/* ======================================================================== */
+
+/*
+ * Position in a range of records of a run, plus a buffer of records that have been read ahead
+ */
+typedef struct
+{
+	uint64_t offset, next, end;
+	std::vector<spill_record_t> buffer;
+	size_t index;
+}
+merge_cursor_t;
+
+/*
+ * Merge the given ranges of records (k-way merge); the emit function is invoked for each record, in sorted order
+ */
+template<typename emit_fn_t>
+static bool merge_cursors(const int fd, std::vector<merge_cursor_t> &cursors, const size_t buffer_size, const emit_fn_t &emit)
+{
+	const auto refill = [&](merge_cursor_t &cursor) -> bool
+	{
+		const size_t count = static_cast<size_t>(std::min(cursor.end - cursor.next, static_cast<uint64_t>(buffer_size)));
+		cursor.buffer.resize(count);
+		cursor.index = 0U;
+#ifdef HAVE_SPILL
+		if(!read_fully(fd, cursor.buffer.data(), count * sizeof(spill_record_t), cursor.offset + cursor.next * sizeof(spill_record_t)))
+		{
+			return false;
+		}
+#else
+		(void)fd;
+#endif
+		cursor.next += count;
+		return true;
+	};
+
+	const auto greater = [&](const size_t lhs, const size_t rhs)
+	{
+		return compare_records(cursors[lhs].buffer[cursors[lhs].index], cursors[rhs].buffer[cursors[rhs].index]) > 0;
+	};
+
+	std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> queue(greater);
+	for(size_t i = 0U; i < cursors.size(); ++i)
+	{
+		if(cursors[i].next < cursors[i].end)
+		{
+			if(!refill(cursors[i]))
+			{
+				return false;
+			}
+			queue.push(i);
+		}
+	}
+
+	while(!queue.empty())
+	{
+		const size_t top = queue.top();
+		merge_cursor_t &cursor = cursors[top];
+		if(!emit(cursor.buffer[cursor.index]))
+		{
+			return false;
+		}
+		queue.pop();
+		if(++cursor.index >= cursor.buffer.size())
+		{
+			if(cursor.next >= cursor.end)
+			{
+				std::vector<spill_record_t>().swap(cursor.buffer);
+				continue; /*range exhausted*/
+			}
+			if(!refill(cursor))
+			{
+				return false;
+			}
+		}
+		queue.push(top);
+	}
+
+	return true;
+}
+
+/* ======================================================================== */
+/* SPILL SORTER                                                             */
+/* ======================================================================== */
+
+/* Size of the partition table that follows the records of each run */
+static const size_t SPILL_TABLE_SIZE = (SPILL_PARTITIONS + 1U) * sizeof(uint64_t);
+
+/*
+ * Constructor; one half of the memory limit is shared by the run buffers of the workers
+ */
+SpillSorter::SpillSorter(const size_t worker_count, const uint64_t mem_limit)
+:
+	m_mem_limit(mem_limit),
+	m_buffer_size(std::max(static_cast<size_t>(mem_limit / 2U / (worker_count * sizeof(spill_record_t))), SPILL_MIN_RUN)),
+	m_fd(-1),
+	m_size(0U),
+	m_records(0U),
+	m_run_count(0U),
+	m_failed(false),
+	m_passes(0U),
+	m_buffers(worker_count)
+{
+}
+
+SpillSorter::~SpillSorter(void)
+{
+#ifdef HAVE_SPILL
+	if(m_fd >= 0)
+	{
+		close(m_fd);
+	}
+#endif
+}
+
+/*
+ * Create the temporary file in the directory given by TMPDIR; the file is unlinked right away
+ */
+bool SpillSorter::open(int &error_code)
+{
+#ifdef HAVE_SPILL
+	const char *const temp_dir = getenv("TMPDIR");
+	std::string path((temp_dir && temp_dir[0U]) ? temp_dir : "/tmp");
+	path += "/mhash384-spill.XXXXXX";
+	if((m_fd = mkstemp(&path[0U])) < 0)
+	{
+		error_code = errno;
+		return false;
+	}
+	unlink(path.c_str());
+	for(std::vector<std::vector<spill_record_t>>::iterator iter = m_buffers.begin(); iter != m_buffers.end(); ++iter)
+	{
+		iter->reserve(m_buffer_size);
+	}
+	return true;
+#else
+	error_code = ENOTSUP;
+	return false;
+#endif
+}
+
+/*
+ * Append a record to the run buffer of the worker; a full buffer is written as a new sorted run
+ */
+bool SpillSorter::append(const size_t worker_id, const uint8_t *const digest, const uint64_t position)
+{
+	std::vector<spill_record_t> &buffer = m_buffers[worker_id];
+	buffer.emplace_back();
+	memcpy(buffer.back().digest, digest, MHASH384_SIZE);
+	buffer.back().position = position;
+	if(buffer.size() >= m_buffer_size)
+	{
+		return write_run(buffer);
+	}
+	return true;
+}
+
+/*
+ * Write the remaining records of all workers; the run buffers are released afterwards
+ */
+bool SpillSorter::flush(void)
+{
+	for(std::vector<std::vector<spill_record_t>>::iterator iter = m_buffers.begin(); iter != m_buffers.end(); ++iter)
+	{
+		if(!iter->empty())
+		{
+			write_run(*iter);
+		}
+		std::vector<spill_record_t>().swap(*iter);
+	}
+	return !m_failed.load();
+}
+
+/*
+ * Sort the buffer and write it to the temporary file, at an atomically allocated offset, followed by its partition table
+ */
+bool SpillSorter::write_run(std::vector<spill_record_t> &buffer)
+{
+	std::sort(buffer.begin(), buffer.end(), [](const spill_record_t &lhs, const spill_record_t &rhs)
+	{
+		return compare_records(lhs, rhs) < 0;
+	});
+
+	run_t run;
+	uint64_t start[SPILL_PARTITIONS + 1U];
+	const size_t count = buffer.size(), size = count * sizeof(spill_record_t);
+	run.offset = m_size.fetch_add(size + SPILL_TABLE_SIZE);
+	run.count = count;
+	for(size_t partition = 0U, index = 0U; partition <= SPILL_PARTITIONS; ++partition)
+	{
+		while((index < count) && (buffer[index].digest[0U] < partition))
+		{
+			++index;
+		}
+		start[partition] = index;
+	}
+	start[SPILL_PARTITIONS] = count;
+
+#ifdef HAVE_SPILL
+	const bool success = write_fully(m_fd, buffer.data(), size, run.offset) && write_fully(m_fd, start, SPILL_TABLE_SIZE, run.offset + size);
+#else
+	const bool success = false;
+#endif
+	buffer.clear();
+	if(!success)
+	{
+		m_failed = true;
+		return false;
+	}
+
+	m_records += count;
+	++m_run_count;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_runs.push_back(run);
+	return true;
+}
+
+/*
+ * Merge all runs, one partition per task; the collision function is invoked for each record whose digest equals the
+ * digest of a preceding record, together with the first record of that digest (i.e. the one with lowest position)
+ */
+bool SpillSorter::merge(ThreadPool &pool, const collision_fn_t &collision_fn)
+{
+	if(m_runs.empty() || m_failed.load())
+	{
+		return !m_failed.load();
+	}
+
+	/* Every thread can hold this many merge buffers of the minimum size within the memory limit */
+	const uint64_t thread_count = pool.thread_count();
+	const size_t max_runs = static_cast<size_t>(std::max(m_mem_limit / (thread_count * SPILL_MIN_BUFFER * sizeof(spill_record_t)), static_cast<uint64_t>(3U)));
+
+	while(m_runs.size() > max_runs)
+	{
+		const size_t group_size = max_runs - 1U; /*one buffer is needed for the output*/
+		const size_t group_count = (m_runs.size() + group_size - 1U) / group_size;
+		const size_t buffer_size = static_cast<size_t>(std::max(m_mem_limit / (thread_count * (group_size + 1U) * sizeof(spill_record_t)), static_cast<uint64_t>(SPILL_MIN_BUFFER)));
+		std::vector<run_t> merged(group_count);
+		pool.start(group_count, [&](const size_t, const size_t group)
+		{
+			const size_t first = group * group_size, count = std::min(group_size, m_runs.size() - first);
+			if(!merge_group(m_runs.data() + first, count, buffer_size, merged[group]))
+			{
+				m_failed = true;
+				pool.cancel();
+			}
+		});
+		pool.wait();
+		if(m_failed.load())
+		{
+			return false;
+		}
+		release_runs(m_runs.data(), m_runs.size());
+		m_runs.swap(merged);
+		++m_passes;
+	}
+
+	const size_t buffer_size = static_cast<size_t>(std::max(m_mem_limit / (thread_count * m_runs.size() * sizeof(spill_record_t)), static_cast<uint64_t>(SPILL_MIN_BUFFER)));
+	pool.start(SPILL_PARTITIONS, [&](const size_t, const size_t partition)
+	{
+		if(!merge_partition(partition, buffer_size, collision_fn))
+		{
+			m_failed = true;
+			pool.cancel();
+		}
+	});
+	pool.wait();
+	++m_passes;
+
+	return !m_failed.load();
+}
+
+/*
+ * Merge a group of runs into a single, longer run
+ */
+bool SpillSorter::merge_group(const run_t *const runs, const size_t count, const size_t buffer_size, run_t &run_out)
+{
+	std::vector<merge_cursor_t> cursors;
+	run_out.count = 0U;
+	for(size_t i = 0U; i < count; ++i)
+	{
+		cursors.push_back(merge_cursor_t { runs[i].offset, 0U, runs[i].count, std::vector<spill_record_t>(), 0U });
+		run_out.count += runs[i].count;
+	}
+	run_out.offset = m_size.fetch_add(run_out.count * sizeof(spill_record_t) + SPILL_TABLE_SIZE);
+
+	uint64_t start[SPILL_PARTITIONS + 1U] = { 0U }, written = 0U;
+	std::vector<spill_record_t> output;
+	output.reserve(buffer_size);
+
+	const auto write_output = [&](void) -> bool
+	{
+#ifdef HAVE_SPILL
+		if(!write_fully(m_fd, output.data(), output.size() * sizeof(spill_record_t), run_out.offset + written * sizeof(spill_record_t)))
+		{
+			return false;
+		}
+#endif
+		written += output.size();
+		output.clear();
+		return true;
+	};
+
+	const bool success = merge_cursors(m_fd, cursors, buffer_size, [&](const spill_record_t &record) -> bool
+	{
+		++start[record.digest[0U] + 1U]; /*count the records of each partition*/
+		output.push_back(record);
+		return (output.size() < buffer_size) || write_output();
+	});
+	if(!(success && write_output()))
+	{
+		return false;
+	}
+
+	for(size_t partition = 1U; partition <= SPILL_PARTITIONS; ++partition)
+	{
+		start[partition] += start[partition - 1U];
+	}
+#ifdef HAVE_SPILL
+	return write_fully(m_fd, start, SPILL_TABLE_SIZE, run_out.offset + written * sizeof(spill_record_t));
+#else
+	return false;
+#endif
+}
+
+/*
+ * Merge a single partition of all runs; the bounds of the partition are read from the partition table of each run
+ */
+bool SpillSorter::merge_partition(const size_t partition, const size_t buffer_size, const collision_fn_t &collision_fn)
+{
+	std::vector<merge_cursor_t> cursors;
+	for(std::vector<run_t>::const_iterator iter = m_runs.begin(); iter != m_runs.end(); ++iter)
+	{
+		uint64_t bounds[2U] = { 0U, 0U };
+#ifdef HAVE_SPILL
+		if(!read_fully(m_fd, bounds, sizeof(bounds), iter->offset + iter->count * sizeof(spill_record_t) + partition * sizeof(uint64_t)))
+		{
+			return false;
+		}
+#endif
+		if(bounds[1U] > bounds[0U])
+		{
+			cursors.push_back(merge_cursor_t { iter->offset, bounds[0U], bounds[1U], std::vector<spill_record_t>(), 0U });
+		}
+	}
+
+	spill_record_t first;
+	bool have_first = false;
+	return merge_cursors(m_fd, cursors, buffer_size, [&](const spill_record_t &current) -> bool
+	{
+		if(have_first && (!memcmp(first.digest, current.digest, MHASH384_SIZE)))
+		{
+			collision_fn(first, current);
+		}
+		else
+		{
+			first = current;
+			have_first = true;
+		}
+		return true;
+	});
+}
+
+/*
+ * Give the disk space of runs that have been merged back to the file system, where supported
+ */
+void SpillSorter::release_runs(const run_t *const runs, const size_t count)
+{
+#if defined(HAVE_SPILL) && defined(FALLOC_FL_PUNCH_HOLE)
+	for(size_t i = 0U; i < count; ++i)
+	{
+		fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)runs[i].offset, (off_t)(runs[i].count * sizeof(spill_record_t) + SPILL_TABLE_SIZE));
+	}
+#else
+	(void)runs;
+	(void)count;
+#endif
+}
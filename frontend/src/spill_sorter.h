@@ -0,0 +1,106 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_SPILL_SORTER_H
+#define INC_MHASH384_SPILL_SORTER_H
+
+#include "common.h"
+#include "mhash384.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class ThreadPool;
+
+/* Number of partitions, selected by the leading digest byte */
+static const size_t SPILL_PARTITIONS = 256U;
+
+/* Minimum number of records per merge buffer */
+static const size_t SPILL_MIN_BUFFER = 64U;
+
+/* Digest of a line, plus the position of the line in the input file */
+typedef struct
+{
+	uint8_t digest[MHASH384_SIZE];
+	uint64_t position;
+}
+spill_record_t;
+
+/*
+ * External-memory duplicate detection
+ *
+ * Every worker collects records in its own buffer; a full buffer is sorted by digest (and position) and written to a
+ * temporary file as a sorted run, followed by the table of its partitions (by the leading digest byte). Finally, each
+ * partition is merged across all runs (k-way merge), and the partitions are merged on the worker threads in parallel.
+ * Records with the same digest end up next to each other, so that duplicates are detected with bounded memory. If
+ * there are too many runs to give each one a merge buffer within the memory limit, groups of runs are merged into
+ * longer runs first, in as many passes as required. Only the offset and the length of each run are kept in memory.
+ */
+class SpillSorter
+{
+public:
+	typedef std::function<void(const spill_record_t &original, const spill_record_t &duplicate)> collision_fn_t;
+
+	SpillSorter(const size_t worker_count, const uint64_t mem_limit);
+	~SpillSorter(void);
+
+	bool open(int &error_code);
+	bool append(const size_t worker_id, const uint8_t *const digest, const uint64_t position);
+	bool flush(void);
+	bool merge(ThreadPool &pool, const collision_fn_t &collision_fn);
+
+	uint64_t record_count(void) const { return m_records.load(); }
+	size_t run_count(void) const { return m_run_count.load(); }
+	size_t merge_passes(void) const { return m_passes; }
+	uint64_t file_size(void) const { return m_size.load(); }
+	bool failed(void) const { return m_failed.load(); }
+
+private:
+	SpillSorter(const SpillSorter&);
+	SpillSorter &operator=(const SpillSorter&);
+
+	typedef struct
+	{
+		uint64_t offset;  /*file offset of the run*/
+		uint64_t count;   /*number of records; the partition table follows the records*/
+	}
+	run_t;
+
+	bool write_run(std::vector<spill_record_t> &buffer);
+	bool merge_group(const run_t *const runs, const size_t count, const size_t buffer_size, run_t &run_out);
+	bool merge_partition(const size_t partition, const size_t buffer_size, const collision_fn_t &collision_fn);
+	void release_runs(const run_t *const runs, const size_t count);
+
+	const uint64_t m_mem_limit;
+	size_t m_buffer_size;
+	int m_fd;
+	std::atomic<uint64_t> m_size, m_records;
+	std::atomic<size_t> m_run_count;
+	std::atomic<bool> m_failed;
+	size_t m_passes;
+	std::mutex m_mutex;
+	std::vector<run_t> m_runs;
+	std::vector<std::vector<spill_record_t>> m_buffers;
+};
+
+bool spill_available(void);
+
+#endif /*INC_MHASH384_SPILL_SORTER_H*/
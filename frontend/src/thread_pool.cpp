@@ -0,0 +1,166 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "thread_pool.h"
+
+/*
+ * Constructor
+ */
+ThreadPool::ThreadPool(const size_t thread_count)
+:
+	m_thread_count((thread_count > 0U) ? thread_count : 1U),
+	m_ranges(m_thread_count),
+	m_cancelled(false)
+{
+}
+
+/*
+ * Destructor
+ */
+ThreadPool::~ThreadPool(void)
+{
+	cancel();
+	wait();
+}
+
+/*
+ * Distribute the tasks to the workers and start the worker threads
+ */
+void ThreadPool::start(const size_t task_count, const task_fn_t &task_fn)
+{
+	wait();
+	m_task_fn = task_fn;
+	m_cancelled.store(false);
+	for(size_t i = 0U; i < m_thread_count; ++i)
+	{
+		std::lock_guard<std::mutex> lock(m_ranges[i].mutex);
+		m_ranges[i].begin = (task_count * i) / m_thread_count;
+		m_ranges[i].end = (task_count * (i + 1U)) / m_thread_count;
+	}
+	for(size_t i = 0U; i < m_thread_count; ++i)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::worker_main, this, i));
+	}
+}
+
+/*
+ * Skip all tasks that have not been started yet
+ */
+void ThreadPool::cancel(void)
+{
+	m_cancelled.store(true);
+}
+
+/*
+ * Wait for all worker threads to finish
+ */
+void ThreadPool::wait(void)
+{
+	for(std::vector<std::thread>::iterator iter = m_threads.begin(); iter != m_threads.end(); ++iter)
+	{
+		iter->join();
+	}
+	m_threads.clear();
+}
+
+/*
+ * Worker thread
+ */
+void ThreadPool::worker_main(const size_t worker_id)
+{
+	size_t task_id;
+	while(next_task(worker_id, task_id))
+	{
+		m_task_fn(worker_id, task_id);
+	}
+}
+
+/*
+ * Fetch the next task, either from the own range or by stealing from another worker
+ */
+bool ThreadPool::next_task(const size_t worker_id, size_t &task_id)
+{
+	if(cancelled())
+	{
+		return false;
+	}
+
+	/* Take the next task from the front of our own range */
+	{
+		range_t &own = m_ranges[worker_id];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if(own.begin < own.end)
+		{
+			task_id = own.begin++;
+			return true;
+		}
+	}
+
+	/* Steal the back half of the largest remaining range */
+	for(;;)
+	{
+		size_t victim = worker_id, remaining = 0U;
+		for(size_t i = 0U; i < m_thread_count; ++i)
+		{
+			if(i != worker_id)
+			{
+				std::lock_guard<std::mutex> lock(m_ranges[i].mutex);
+				if(m_ranges[i].end - m_ranges[i].begin > remaining)
+				{
+					remaining = m_ranges[i].end - m_ranges[i].begin;
+					victim = i;
+				}
+			}
+		}
+		if(!remaining)
+		{
+			return false; /*all work is done*/
+		}
+		size_t begin, end;
+		{
+			range_t &other = m_ranges[victim];
+			std::lock_guard<std::mutex> lock(other.mutex);
+			if(other.begin >= other.end)
+			{
+				continue; /*range was drained in the meantime*/
+			}
+			end = other.end;
+			begin = other.end = other.end - ((other.end - other.begin + 1U) / 2U);
+		}
+		task_id = begin++;
+		if(begin < end)
+		{
+			range_t &own = m_ranges[worker_id];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			own.begin = begin;
+			own.end = end;
+		}
+		return true;
+	}
+}
+
+/*
+ * Get the number of online CPUs
+ */
+size_t get_cpu_count(void)
+{
+	const unsigned int count = std::thread::hardware_concurrency();
+	return (count > 0U) ? count : 1U;
+}
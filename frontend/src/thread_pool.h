@@ -0,0 +1,77 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_THREAD_POOL_H
+#define INC_MHASH384_THREAD_POOL_H
+
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing thread pool
+ *
+ * Runs the tasks 0 to N-1 on a fixed number of worker threads. Initially, every worker owns a contiguous range of the
+ * tasks, which it processes front to back; a worker that has run out of tasks steals the back half of the remaining
+ * range of another worker. Each task function receives the index of the worker, so that per-worker resources (e.g.
+ * I/O buffers) can be reused across tasks.
+ */
+class ThreadPool
+{
+public:
+	typedef std::function<void(const size_t worker_id, const size_t task_id)> task_fn_t;
+
+	ThreadPool(const size_t thread_count);
+	~ThreadPool(void);
+
+	void start(const size_t task_count, const task_fn_t &task_fn);
+	void cancel(void);
+	void wait(void);
+
+	size_t thread_count(void) const { return m_thread_count; }
+	bool cancelled(void) const { return m_cancelled.load(std::memory_order_relaxed); }
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool &operator=(const ThreadPool&);
+
+	typedef struct
+	{
+		std::mutex mutex;
+		size_t begin, end;
+	}
+	range_t;
+
+	void worker_main(const size_t worker_id);
+	bool next_task(const size_t worker_id, size_t &task_id);
+
+	const size_t m_thread_count;
+	std::vector<range_t> m_ranges;
+	std::vector<std::thread> m_threads;
+	std::atomic<bool> m_cancelled;
+	task_fn_t m_task_fn;
+};
+
+size_t get_cpu_count(void);
+
+#endif /*INC_MHASH384_THREAD_POOL_H*/
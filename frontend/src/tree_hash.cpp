@@ -0,0 +1,277 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "tree_hash.h"
+#include "thread_pool.h"
+#include "phase_timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <sys/stat.h>
+#include <errno.h>
+
+/* Win32 I/O stuff */
+#if defined(_WIN32) && defined(_MSC_VER)
+#define fstat _fstat
+#define stat _stat
+#define fileno _fileno
+#endif
+
+/* POSIX I/O stuff */
+#if !defined(_WIN32)
+#define HAVE_PREAD 1
+#include <unistd.h>
+#endif
+
+/* Size of a single leaf; the leaves are read into the pipeline buffers of the I/O contexts */
+static const size_t LEAF_SIZE = MHASH384_TREE_LEAF_SIZE;
+static_assert(LEAF_SIZE <= PIPELINE_BUFFER_SIZE, "Leaf size exceeds the pipeline buffer size!");
+
+/* Digest of a leaf of the current window */
+typedef struct
+{
+	uint8_t digest[MHASH384_SIZE];
+	size_t length;
+}
+leaf_t;
+
+/*
+ * Check whether the cancellation has been requested
+ */
+static inline bool is_cancelled(const ThreadPool *const pool)
+{
+	return pool && pool->cancelled();
+}
+
+/*
+ * Append the digests of the current window to the tree, in leaf order
+ */
+static void append_leaves(mhash384_tree_t &tree, const std::vector<leaf_t> &leaves, const size_t count)
+{
+	for(size_t i = 0U; i < count; ++i)
+	{
+		mhash384_tree_append(&tree, leaves[i].digest, leaves[i].length);
+	}
+}
+
+/* ======================================================================== */
+/* REGULAR FILES                                                            */
+/* ======================================================================== */
+
+#ifdef HAVE_PREAD
+
+/*
+ * Read exactly "length" bytes at the given offset, unless EOF or an error is encountered
+ */
+static size_t read_at(const int fd, uint8_t *const buffer, const size_t length, const uint64_t offset)
+{
+	size_t total = 0U;
+	while(total < length)
+	{
+		const ssize_t count = pread(fd, buffer + total, length - total, (off_t)(offset + total));
+		if(count <= 0)
+		{
+			if((count < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+			break; /*EOF or error*/
+		}
+		total += (size_t)count;
+	}
+	return total;
+}
+
+/*
+ * Every worker reads its leaves with pread() into its own buffer and hashes them; the file is processed in windows
+ * of a few leaves per worker, so that only the digests of the current window have to be kept in memory. A short read
+ * means that the size from fstat() was wrong (e.g. sysfs), so the caller has to start over with the stream path
+ */
+static file_status_t tree_read_file(const int fd, const uint64_t file_size, mhash384_tree_t &tree, const options_t &options, const ThreadPool *const outer_pool, bool &short_read)
+{
+	const uint64_t leaf_count = (file_size + LEAF_SIZE - 1U) / LEAF_SIZE;
+	ThreadPool pool((size_t)std::min(leaf_count, (uint64_t)options.thread_count));
+	const size_t window = pool.thread_count() * TREE_WINDOW_LEAVES;
+	std::vector<IOContext> contexts(pool.thread_count());
+	std::vector<leaf_t> leaves(window);
+	std::atomic<bool> read_error(false);
+	short_read = false;
+
+	for(uint64_t first = 0U; first < leaf_count; first += window)
+	{
+		const size_t count = (size_t)std::min(leaf_count - first, (uint64_t)window);
+		pool.start(count, [&](const size_t worker_id, const size_t task_id)
+		{
+			const uint64_t offset = (first + task_id) * LEAF_SIZE;
+			const size_t length = (size_t)std::min(file_size - offset, (uint64_t)LEAF_SIZE);
+			uint8_t *const buffer = contexts[worker_id].ring_buffer(0U);
+			if(read_at(fd, buffer, length, offset) != length)
+			{
+				read_error.store(true);
+				pool.cancel();
+				return;
+			}
+			{
+				PhaseTimer timer(PHASE_HASH);
+				mhash384_tree_leaf(leaves[task_id].digest, buffer, length);
+			}
+			leaves[task_id].length = length;
+		});
+		pool.wait();
+		if(read_error.load())
+		{
+			short_read = true;
+			return FILE_READ_ERROR;
+		}
+		append_leaves(tree, leaves, count);
+		if(is_cancelled(outer_pool))
+		{
+			return FILE_CANCELLED;
+		}
+	}
+
+	return FILE_SUCCESS;
+}
+
+#endif //HAVE_PREAD
+
+/* ======================================================================== */
+/* STREAMS                                                                  */
+/* ======================================================================== */
+
+/*
+ * Read until the buffer is full, or EOF or an error is encountered
+ */
+static size_t read_fully(FILE *const input, uint8_t *const buffer, const size_t size)
+{
+	size_t total = 0U;
+	while(total < size)
+	{
+		const size_t count = fread(buffer + total, sizeof(uint8_t), size - total, input);
+		if(!count)
+		{
+			break; /*EOF or error*/
+		}
+		total += count;
+	}
+	return total;
+}
+
+/*
+ * The calling thread reads the input sequentially, window by window, into one of two buffers; while the workers are
+ * hashing the leaves of the current window, the next window is read into the other buffer
+ */
+static file_status_t tree_read_stream(FILE *const input, mhash384_tree_t &tree, const options_t &options, const ThreadPool *const outer_pool)
+{
+	ThreadPool pool(options.thread_count);
+	const size_t window = pool.thread_count() * TREE_STREAM_LEAVES;
+	std::vector<uint8_t> buffers[2U] = { std::vector<uint8_t>(window * LEAF_SIZE), std::vector<uint8_t>(window * LEAF_SIZE) };
+	std::vector<leaf_t> leaves(window);
+
+	size_t current = 0U, filled = read_fully(input, buffers[current].data(), window * LEAF_SIZE);
+	while(filled > 0U)
+	{
+		const uint8_t *const data = buffers[current].data();
+		const size_t length = filled, count = (length + LEAF_SIZE - 1U) / LEAF_SIZE;
+		pool.start(count, [&](const size_t, const size_t task_id)
+		{
+			const size_t offset = task_id * LEAF_SIZE;
+			leaves[task_id].length = std::min(length - offset, LEAF_SIZE);
+			PhaseTimer timer(PHASE_HASH);
+			mhash384_tree_leaf(leaves[task_id].digest, data + offset, leaves[task_id].length);
+		});
+		current ^= 1U;
+		filled = (length == window * LEAF_SIZE) ? read_fully(input, buffers[current].data(), window * LEAF_SIZE) : 0U;
+		pool.wait();
+		append_leaves(tree, leaves, count);
+		if(is_cancelled(outer_pool))
+		{
+			return FILE_CANCELLED;
+		}
+	}
+
+	return ferror(input) ? FILE_READ_ERROR : FILE_SUCCESS;
+}
+
+/* ======================================================================== */
+/* PUBLIC FUNCTIONS                                                         */
+/* ======================================================================== */
+
+/*
+ * Compute the tree hash of the input file, hashing the leaves on all worker threads
+ */
+file_status_t tree_hash_file(const CHAR_T *const file_name, file_result_t &result, const options_t &options, const ThreadPool *const outer_pool)
+{
+	/* Open the input file */
+	PhaseTimer open_timer(PHASE_OPEN);
+	errno = 0;
+	FILE *const input = file_name ? FOPEN(file_name, STR("rb")) : stdin;
+	if(!input)
+	{
+		result.error_code = errno;
+		return result.status = FILE_OPEN_ERROR;
+	}
+
+	/* Check if file is directory (this is required for Linux!)*/
+	struct stat file_info;
+	const bool have_info = !fstat(fileno(input), &file_info);
+	if(have_info && ((file_info.st_mode & S_IFMT) == S_IFDIR))
+	{
+		if(file_name)
+		{
+			fclose(input);
+		}
+		return result.status = FILE_DIRECTORY;
+	}
+
+	/* Process complete input */
+	open_timer.stop();
+	mhash384_tree_t tree;
+	mhash384_tree_init(&tree);
+	bool use_stream = true;
+#ifdef HAVE_PREAD
+	if(file_name && have_info && S_ISREG(file_info.st_mode) && (file_info.st_size > 0))
+	{
+		result.status = tree_read_file(fileno(input), (uint64_t)file_info.st_size, tree, options, outer_pool, use_stream);
+		if(use_stream)
+		{
+			mhash384_tree_init(&tree); /*start over, pread() does not move the file position*/
+		}
+	}
+#endif
+	if(use_stream)
+	{
+		result.status = tree_read_stream(input, tree, options, outer_pool);
+	}
+
+	/* Close the input file */
+	if(file_name)
+	{
+		fclose(input);
+	}
+
+	if(result.status == FILE_SUCCESS)
+	{
+		mhash384_tree_final(&tree, result.digest);
+		phase_count_bytes(tree.total_len); /*the leaves have been hashed on the worker threads*/
+	}
+	return result.status;
+}
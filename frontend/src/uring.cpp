@@ -0,0 +1,667 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#include "uring.h"
+#include "thread_pool.h"
+#include "phase_timer.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <errno.h>
+
+/* Linux io_uring stuff */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(STATX_TYPE)
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+/* Alignment of the read buffers */
+static const size_t URING_ALIGNMENT = 4096U;
+
+/* Kind of request, stored in the lower bits of the "user_data" field */
+typedef enum
+{
+	OP_OPEN  = 0,
+	OP_STATX = 1,
+	OP_READ  = 2,
+	OP_CLOSE = 3
+}
+uring_op_t;
+
+static const unsigned int OP_BITS = 2U;
+
+/* State of a stream buffer */
+typedef enum
+{
+	SLOT_IDLE    = 0,
+	SLOT_READING = 1,
+	SLOT_READY   = 2
+}
+slot_state_t;
+
+/* A single buffer of a stream */
+typedef struct
+{
+	slot_state_t state;
+	uint64_t offset;
+	size_t length;   /*number of bytes expected*/
+	size_t done;     /*number of bytes read so far*/
+}
+stream_slot_t;
+
+/* A single file that is in flight */
+typedef struct
+{
+	size_t index;          /*index of the file in the current batch*/
+	bool active;
+	int fd;
+	int error_code;        /*error of the "open" request*/
+	unsigned int pending;  /*number of outstanding "open" and "statx" requests*/
+	bool have_info;
+	struct statx info;
+	uint64_t offset;
+	uint64_t start_ns;     /*time the file has been started, for the phase statistics*/
+	mhash384_t ctx;
+}
+uring_file_t;
+
+struct uring_t
+{
+	int fd;
+	void *ring_ptr;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned int *sq_head, *sq_tail, *sq_array, sq_mask, sq_entries;
+	unsigned int *cq_head, *cq_tail, cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned int sq_local_tail, to_submit;
+	int error_code;        /*the ring has failed, it can not be used anymore*/
+	bool fixed_buffers;
+	uint8_t *buffers;
+	uring_file_t files[URING_QUEUE_DEPTH];
+};
+
+/* ======================================================================== */
+/* SYSTEM CALLS                                                             */
+/* ======================================================================== */
+
+static inline int sys_uring_setup(const unsigned int entries, struct io_uring_params *const params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int sys_uring_enter(const int fd, const unsigned int to_submit, const unsigned int min_complete, const unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline int sys_uring_register(const int fd, const unsigned int opcode, const void *const arg, const unsigned int nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* ======================================================================== */
+/* RING MANAGEMENT                                                          */
+/* ======================================================================== */
+
+/*
+ * Check whether the kernel supports all the operations that we are going to use
+ */
+static bool probe_operations(const int fd)
+{
+	static const uint8_t REQUIRED_OPS[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE };
+	const size_t probe_size = sizeof(struct io_uring_probe) + 256U * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *const probe = (struct io_uring_probe*)calloc(1U, probe_size);
+	if(!probe)
+	{
+		return false;
+	}
+	bool supported = (sys_uring_register(fd, IORING_REGISTER_PROBE, probe, 256U) >= 0);
+	for(size_t i = 0U; supported && (i < sizeof(REQUIRED_OPS)); ++i)
+	{
+		supported = (REQUIRED_OPS[i] <= probe->last_op) && (probe->ops[REQUIRED_OPS[i]].flags & IO_URING_OP_SUPPORTED);
+	}
+	free(probe);
+	return supported;
+}
+
+/*
+ * Map the submission and completion queues into our address space
+ */
+static bool map_rings(uring_t *const ring, const struct io_uring_params &params)
+{
+	const size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	const size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+	ring->ring_ptr = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if(ring->ring_ptr == MAP_FAILED)
+	{
+		ring->ring_ptr = NULL;
+		return false;
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	void *const sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(sqes == MAP_FAILED)
+	{
+		return false;
+	}
+	uint8_t *const base = (uint8_t*)ring->ring_ptr;
+	ring->sqes       = (struct io_uring_sqe*)sqes;
+	ring->sq_head    = (unsigned int*)(base + params.sq_off.head);
+	ring->sq_tail    = (unsigned int*)(base + params.sq_off.tail);
+	ring->sq_array   = (unsigned int*)(base + params.sq_off.array);
+	ring->sq_mask    = *(unsigned int*)(base + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+	ring->cq_head    = (unsigned int*)(base + params.cq_off.head);
+	ring->cq_tail    = (unsigned int*)(base + params.cq_off.tail);
+	ring->cq_mask    = *(unsigned int*)(base + params.cq_off.ring_mask);
+	ring->cqes       = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+	ring->sq_local_tail = *ring->sq_tail;
+	return true;
+}
+
+/*
+ * Allocate the read buffers and register them with the kernel; if registration fails (e.g. because of the
+ * RLIMIT_MEMLOCK limit on older kernels), we simply fall back to ordinary reads
+ */
+static bool setup_buffers(uring_t *const ring)
+{
+	void *ptr = NULL;
+	if(posix_memalign(&ptr, URING_ALIGNMENT, URING_QUEUE_DEPTH * URING_BUFFER_SIZE))
+	{
+		return false;
+	}
+	ring->buffers = (uint8_t*)ptr;
+	struct iovec iov[URING_QUEUE_DEPTH];
+	for(size_t i = 0U; i < URING_QUEUE_DEPTH; ++i)
+	{
+		iov[i].iov_base = ring->buffers + (i * URING_BUFFER_SIZE);
+		iov[i].iov_len = URING_BUFFER_SIZE;
+	}
+	ring->fixed_buffers = (sys_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov, (unsigned int)URING_QUEUE_DEPTH) >= 0);
+	return true;
+}
+
+/*
+ * Get the next free submission queue entry; there always is one, because the queue has been sized for the maximum
+ * number of requests that we ever prepare between two calls of submit_and_wait()
+ */
+static struct io_uring_sqe *get_sqe(uring_t *const ring, const uring_op_t op, const size_t slot)
+{
+	const unsigned int index = (ring->sq_local_tail++) & ring->sq_mask;
+	struct io_uring_sqe *const sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->user_data = (((uint64_t)slot) << OP_BITS) | ((uint64_t)op);
+	ring->sq_array[index] = index;
+	++ring->to_submit;
+	return sqe;
+}
+
+/*
+ * Publish the prepared requests and wait for the given number of completions
+ */
+static int submit_and_wait(uring_t *const ring, const unsigned int min_complete)
+{
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	for(;;)
+	{
+		const int submitted = sys_uring_enter(ring->fd, ring->to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0U);
+		if(submitted >= 0)
+		{
+			ring->to_submit -= (unsigned int)submitted;
+			return 0;
+		}
+		if(errno != EINTR)
+		{
+			return (errno == EAGAIN) || (errno == EBUSY) ? 0 : errno; /*completion queue is full, reap first*/
+		}
+	}
+}
+
+/* ======================================================================== */
+/* FILE STATE MACHINE                                                       */
+/* ======================================================================== */
+
+static void queue_open(uring_t *const ring, const size_t slot, const CHAR_T *const file_name)
+{
+	uring_file_t &file = ring->files[slot];
+	struct io_uring_sqe *sqe = get_sqe(ring, OP_OPEN, slot);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t)(uintptr_t)file_name;
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	sqe = get_sqe(ring, OP_STATX, slot);
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t)(uintptr_t)file_name;
+	sqe->len = STATX_TYPE;
+	sqe->off = (uint64_t)(uintptr_t)&file.info;
+	file.pending = 2U;
+}
+
+static void queue_read(uring_t *const ring, const size_t slot)
+{
+	const uring_file_t &file = ring->files[slot];
+	struct io_uring_sqe *const sqe = get_sqe(ring, OP_READ, slot);
+	sqe->opcode = ring->fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = file.fd;
+	sqe->addr = (uint64_t)(uintptr_t)(ring->buffers + (slot * URING_BUFFER_SIZE));
+	sqe->len = (uint32_t)URING_BUFFER_SIZE;
+	sqe->off = S_ISREG(file.info.stx_mode) ? file.offset : (uint64_t)-1; /*pipes etc. read at the current position*/
+	sqe->buf_index = (uint16_t)slot;
+}
+
+static void queue_stream_read(uring_t *const ring, const int fd, const size_t slot, uint8_t *const buffer, const size_t buffer_size, const stream_slot_t &stream_slot)
+{
+	struct io_uring_sqe *const sqe = get_sqe(ring, OP_READ, slot);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)(buffer + stream_slot.done);
+	sqe->len = (uint32_t)(buffer_size - stream_slot.done); /*always up to the end of the buffer, for O_DIRECT*/
+	sqe->off = stream_slot.offset + stream_slot.done;
+}
+
+static void queue_close(uring_t *const ring, const int fd)
+{
+	struct io_uring_sqe *const sqe = get_sqe(ring, OP_CLOSE, 0U);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = fd;
+}
+
+/*
+ * Complete the file, close the file descriptor and release the slot
+ */
+static void finish_file(uring_t *const ring, const size_t slot, file_result_t *const results, const file_status_t status, const int error_code, const file_callback_t &callback)
+{
+	uring_file_t &file = ring->files[slot];
+	file_result_t &result = results[file.index];
+	if((result.status = status) == FILE_SUCCESS)
+	{
+		mhash384_final(&file.ctx, result.digest);
+		phase_record_file(file.offset, phase_time_now().wall_ns - file.start_ns);
+	}
+	result.error_code = error_code;
+	if(file.fd >= 0)
+	{
+		queue_close(ring, file.fd);
+	}
+	file.active = false;
+	callback(file.index);
+}
+
+/*
+ * Handle a single completion
+ */
+static void handle_completion(uring_t *const ring, const uint64_t user_data, const int res, file_result_t *const results, const ThreadPool *const pool, const file_callback_t &callback)
+{
+	const uring_op_t op = (uring_op_t)(user_data & ((1U << OP_BITS) - 1U));
+	if(op == OP_CLOSE)
+	{
+		return; /*nothing to do*/
+	}
+
+	const size_t slot = (size_t)(user_data >> OP_BITS);
+	uring_file_t &file = ring->files[slot];
+	switch(op)
+	{
+	case OP_OPEN:
+		if(res >= 0)
+		{
+			file.fd = res;
+		}
+		else
+		{
+			file.error_code = -res;
+		}
+		break;
+	case OP_STATX:
+		file.have_info = (res >= 0);
+		break;
+	default:
+		if(res < 0)
+		{
+			finish_file(ring, slot, results, FILE_READ_ERROR, -res, callback);
+		}
+		else if(pool && pool->cancelled())
+		{
+			finish_file(ring, slot, results, FILE_CANCELLED, 0, callback);
+		}
+		else
+		{
+			{
+				PhaseTimer timer(PHASE_HASH, (uint64_t)res);
+				mhash384_update(&file.ctx, ring->buffers + (slot * URING_BUFFER_SIZE), (size_t)res);
+			}
+			file.offset += (uint64_t)res;
+			if(res == 0)
+			{
+				finish_file(ring, slot, results, FILE_SUCCESS, 0, callback); /*EOF, the size from "statx" may be stale or bogus (e.g. procfs)*/
+			}
+			else
+			{
+				queue_read(ring, slot);
+			}
+		}
+		return;
+	}
+
+	/* Both "open" and "statx" are done, decide how to go on */
+	if(--file.pending == 0U)
+	{
+		if(file.fd < 0)
+		{
+			finish_file(ring, slot, results, FILE_OPEN_ERROR, file.error_code, callback);
+		}
+		else if(file.have_info && S_ISDIR(file.info.stx_mode))
+		{
+			finish_file(ring, slot, results, FILE_DIRECTORY, 0, callback);
+		}
+		else
+		{
+			if(!file.have_info)
+			{
+				file.info.stx_mode = 0U; /*unknown type, read until EOF*/
+			}
+			queue_read(ring, slot);
+		}
+	}
+}
+
+#endif //HAVE_IO_URING
+
+/* ======================================================================== */
+/* PUBLIC FUNCTIONS                                                         */
+/* ======================================================================== */
+
+/*
+ * Check whether io_uring is supported by the running kernel (the result is cached)
+ */
+bool uring_available(void)
+{
+#ifdef HAVE_IO_URING
+	static const bool available = []()
+	{
+		uring_t *const ring = uring_create();
+		uring_destroy(ring);
+		return ring != NULL;
+	}();
+	return available;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Create a new ring, including the read buffers; returns NULL, if io_uring is not available
+ */
+uring_t *uring_create(void)
+{
+#ifdef HAVE_IO_URING
+	uring_t *const ring = (uring_t*)calloc(1U, sizeof(uring_t));
+	if(!ring)
+	{
+		return NULL;
+	}
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	if((ring->fd = sys_uring_setup((unsigned int)(8U * URING_QUEUE_DEPTH), &params)) < 0)
+	{
+		free(ring);
+		return NULL;
+	}
+	if(!((params.features & IORING_FEAT_SINGLE_MMAP) && probe_operations(ring->fd) && map_rings(ring, params) && setup_buffers(ring)))
+	{
+		uring_destroy(ring);
+		return NULL;
+	}
+	return ring;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * Destroy the ring
+ */
+void uring_destroy(uring_t *const ring)
+{
+#ifdef HAVE_IO_URING
+	if(ring)
+	{
+		if(ring->sqes)
+		{
+			munmap(ring->sqes, ring->sqes_size);
+		}
+		if(ring->ring_ptr)
+		{
+			munmap(ring->ring_ptr, ring->ring_size);
+		}
+		close(ring->fd); /*also unregisters the buffers*/
+		free(ring->buffers);
+		free(ring);
+	}
+#endif
+}
+
+/*
+ * Hash a batch of files through the ring: up to URING_QUEUE_DEPTH files are in flight at the same time, and each
+ * file is hashed as its reads complete; the callback is invoked for each file, in the order of completion
+ */
+void uring_hash_files(uring_t *const ring, const CHAR_T *const *const file_names, const size_t count, file_result_t *const results, const ThreadPool *const pool, const file_callback_t &callback)
+{
+#ifdef HAVE_IO_URING
+	size_t next = 0U;
+	while(!ring->error_code)
+	{
+		/* Start as many new files as there are free slots */
+		size_t active = 0U;
+		for(size_t slot = 0U; slot < URING_QUEUE_DEPTH; ++slot)
+		{
+			uring_file_t &file = ring->files[slot];
+			if((!file.active) && (next < count) && (!(pool && pool->cancelled())))
+			{
+				file.index = next;
+				file.active = true;
+				file.fd = -1;
+				file.error_code = 0;
+				file.have_info = false;
+				file.offset = 0U;
+				file.start_ns = phase_time_now().wall_ns;
+				mhash384_init(&file.ctx);
+				queue_open(ring, slot, file_names[next++]);
+			}
+			if(file.active)
+			{
+				++active;
+			}
+		}
+		if(!active)
+		{
+			break;
+		}
+
+		/* Submit requests and wait for completions */
+		if((ring->error_code = submit_and_wait(ring, 1U)))
+		{
+			for(size_t slot = 0U; slot < URING_QUEUE_DEPTH; ++slot)
+			{
+				if(ring->files[slot].active)
+				{
+					ring->files[slot].fd = -1; /*the ring is unusable, just leak the descriptor*/
+					finish_file(ring, slot, results, FILE_READ_ERROR, ring->error_code, callback);
+				}
+			}
+			break;
+		}
+
+		/* Process all completions */
+		unsigned int head = *ring->cq_head;
+		while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			const struct io_uring_cqe &cqe = ring->cqes[head & ring->cq_mask];
+			const uint64_t user_data = cqe.user_data;
+			const int res = cqe.res;
+			__atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+			handle_completion(ring, user_data, res, results, pool, callback);
+		}
+	}
+
+	/* Submit the outstanding "close" requests, their completions are reaped with the next batch */
+	if(ring->to_submit && (!ring->error_code))
+	{
+		ring->error_code = submit_and_wait(ring, 0U);
+	}
+
+	/* Files that have not been started are cancelled, or failed if the ring is broken */
+	for(; next < count; ++next)
+	{
+		results[next].status = ring->error_code ? FILE_READ_ERROR : FILE_CANCELLED;
+		results[next].error_code = ring->error_code;
+		callback(next);
+	}
+#else
+	(void)ring; (void)file_names; (void)count; (void)results; (void)pool; (void)callback;
+#endif
+}
+
+/*
+ * Read a single regular file with up to "buffer_count" reads in flight at the same time, i.e. queue depth greater
+ * than one; the consumer is invoked for each buffer, strictly in the order of the file offsets. The buffers must
+ * remain valid until the function returns. Returns zero on success, or the error code of the first failed read.
+ */
+int uring_read_stream(uring_t *const ring, const int fd, uint64_t file_size, uint8_t *const *const buffers, const size_t buffer_count, const size_t buffer_size, const uring_consumer_t &consumer)
+{
+#ifdef HAVE_IO_URING
+	if(ring->error_code)
+	{
+		return ring->error_code;
+	}
+
+	std::vector<stream_slot_t> slots(buffer_count);
+	uint64_t next_offset = 0U;
+	size_t fill = 0U, drain = 0U, inflight = 0U;
+	int error_code = 0;
+	bool stop = false;
+
+	for(;;)
+	{
+		/* Keep all idle buffers busy */
+		while((!stop) && (next_offset < file_size) && (slots[fill].state == SLOT_IDLE))
+		{
+			stream_slot_t &slot = slots[fill];
+			slot.state = SLOT_READING;
+			slot.offset = next_offset;
+			slot.length = (size_t)std::min(file_size - next_offset, (uint64_t)buffer_size);
+			slot.done = 0U;
+			queue_stream_read(ring, fd, fill, buffers[fill], buffer_size, slot);
+			++inflight;
+			next_offset += buffer_size;
+			fill = (fill + 1U) % buffer_count;
+		}
+
+		/* Pass the next buffer to the consumer, if it is complete */
+		if((!stop) && (slots[drain].state == SLOT_READY))
+		{
+			stop = !consumer(buffers[drain], slots[drain].done, slots[drain].offset);
+			slots[drain].state = SLOT_IDLE;
+			drain = (drain + 1U) % buffer_count;
+			continue;
+		}
+		if(!inflight)
+		{
+			break;
+		}
+
+		/* Submit requests and wait for completions */
+		if((ring->error_code = submit_and_wait(ring, 1U)))
+		{
+			return ring->error_code; /*the ring is unusable*/
+		}
+
+		/* Process all completions */
+		unsigned int head = *ring->cq_head;
+		while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			const struct io_uring_cqe &cqe = ring->cqes[head & ring->cq_mask];
+			const uint64_t user_data = cqe.user_data;
+			const int res = cqe.res;
+			__atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+			if((user_data & ((1U << OP_BITS) - 1U)) != OP_READ)
+			{
+				continue; /*left over from a previous batch*/
+			}
+			const size_t index = (size_t)(user_data >> OP_BITS);
+			stream_slot_t &slot = slots[index];
+			--inflight;
+			if(res < 0)
+			{
+				if(!error_code)
+				{
+					error_code = -res;
+				}
+				stop = true;
+				slot.state = SLOT_IDLE;
+			}
+			else if(res == 0)
+			{
+				slot.state = SLOT_READY; /*the file has been truncated*/
+				file_size = std::min(file_size, slot.offset + slot.done);
+			}
+			else if((slot.done += (size_t)res) >= slot.length)
+			{
+				slot.done = slot.length;
+				slot.state = SLOT_READY;
+			}
+			else if(!stop)
+			{
+				if((slot.offset + slot.done) % URING_ALIGNMENT)
+				{
+					fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT); /*short read, O_DIRECT can not continue at an unaligned offset*/
+				}
+				queue_stream_read(ring, fd, index, buffers[index], buffer_size, slot); /*short read, continue*/
+				++inflight;
+			}
+			else
+			{
+				slot.state = SLOT_IDLE;
+			}
+		}
+	}
+
+	return error_code;
+#else
+	(void)ring; (void)fd; (void)file_size; (void)buffers; (void)buffer_count; (void)buffer_size; (void)consumer;
+	return ENOSYS;
+#endif
+}
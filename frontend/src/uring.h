@@ -0,0 +1,45 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* MHash-384 - Simple fast portable secure hashing library                                        */
+/* Copyright(c) 2016-2020 LoRd_MuldeR <mulder2@gmx.de>                                            */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+#ifndef INC_MHASH384_URING_H
+#define INC_MHASH384_URING_H
+
+#include "common.h"
+#include "file_io.h"
+
+class ThreadPool;
+
+/* Number of files that are in flight at the same time, and size of the read buffer of each file */
+static const size_t URING_QUEUE_DEPTH = 16U;
+static const size_t URING_BUFFER_SIZE = 1U << 17;
+
+/* Opaque ring state, owned by a single thread */
+typedef struct uring_t uring_t;
+
+/* Consumer of a single stream buffer; returns false to stop reading */
+typedef std::function<bool(const uint8_t *const data, const size_t length, const uint64_t offset)> uring_consumer_t;
+
+bool uring_available(void);
+uring_t *uring_create(void);
+void uring_destroy(uring_t *const ring);
+void uring_hash_files(uring_t *const ring, const CHAR_T *const *const file_names, const size_t count, file_result_t *const results, const ThreadPool *const pool, const file_callback_t &callback);
+int uring_read_stream(uring_t *const ring, const int fd, uint64_t file_size, uint8_t *const *const buffers, const size_t buffer_count, const size_t buffer_size, const uring_consumer_t &consumer);
+
+#endif /*INC_MHASH384_URING_H*/
@@ -21,7 +21,15 @@
 #include "mhash384.h"
 #include "utils.h"
 
-#include <sstream>
+/*
+ * Runtime CPU dispatch of the encoders (x86 only)
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && ((defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))) || (defined(__clang__) && ((__clang_major__ > 3) || ((__clang_major__ == 3) && (__clang_minor__ >= 9)))))
+#	define ENCODE_DISPATCH 1
+#	define TARGET_SSSE3 __attribute__((target("ssse3")))
+#	define TARGET_AVX2  __attribute__((target("avx2")))
+#	include <immintrin.h>
+#endif
 
 /*
  * Get base name from path
@@ -38,125 +46,435 @@ const CHAR_T * get_basename(const CHAR_T *const path)
 }
 
 /*
- * Convert byte array to Hex-string
+ * Match name against a glob pattern, supporting '*', '?' and character classes like "[a-z]" or "[!0-9]"
  */
-std::string bytes_to_hex(const uint8_t *const data, const size_t len, const bool lower_case)
+static bool match_class(const CHAR_T *&pattern, const CHAR_T c)
+{
+	const CHAR_T *ptr = pattern + 1U;
+	const bool negate = (*ptr == STR('!')) || (*ptr == STR('^'));
+	if(negate)
+	{
+		++ptr;
+	}
+	bool matched = false;
+	for(bool first = true; *ptr && (first || (*ptr != STR(']'))); first = false)
+	{
+		if((ptr[1U] == STR('-')) && ptr[2U] && (ptr[2U] != STR(']')))
+		{
+			matched = matched || ((c >= ptr[0U]) && (c <= ptr[2U]));
+			ptr += 3U;
+		}
+		else
+		{
+			matched = matched || (c == ptr[0U]);
+			++ptr;
+		}
+	}
+	if(*ptr != STR(']'))
+	{
+		return (c == STR('[')) && (++pattern, true); /*unterminated, match literally*/
+	}
+	pattern = ptr + 1U;
+	return matched != negate;
+}
+
+bool glob_match(const CHAR_T *pattern, const CHAR_T *name)
+{
+	const CHAR_T *star_pattern = NULL, *star_name = NULL;
+	while(*name)
+	{
+		if(*pattern == STR('*'))
+		{
+			star_pattern = ++pattern;
+			star_name = name;
+			continue;
+		}
+		const CHAR_T *next = pattern;
+		bool matched;
+		if(*pattern == STR('['))
+		{
+			matched = match_class(next, *name);
+		}
+		else
+		{
+			matched = *pattern && ((*pattern == STR('?')) || (*pattern == *name));
+			++next;
+		}
+		if(matched)
+		{
+			pattern = next;
+			++name;
+		}
+		else if(star_pattern)
+		{
+			pattern = star_pattern; /*backtrack: let the last star consume one more character*/
+			name = ++star_name;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while(*pattern == STR('*'))
+	{
+		++pattern;
+	}
+	return !(*pattern);
+}
+
+static const char HEXCHARS_UPR[] = "0123456789ABCDEF";
+static const char HEXCHARS_LWR[] = "0123456789abcdef";
+static const char B64CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*
+ * Each SIMD encoder processes as many whole blocks as possible, without reading beyond the end of the input, and
+ * returns the number of input bytes that have been consumed; the remainder is encoded by the scalar code
+ */
+typedef size_t (*simd_encoder_t)(char *const out, const uint8_t *const data, const size_t len, const char *const table);
+
+static size_t encode_none(char *const, const uint8_t *const, const size_t, const char *const)
+{
+	return 0U;
+}
+
+#ifdef ENCODE_DISPATCH
+
+/*
+ * Hex: split each byte into its two nibbles, interleave them, and look up the characters with a byte shuffle
+ */
+TARGET_SSSE3 static size_t hex_ssse3(char *const out, const uint8_t *const data, const size_t len, const char *const table)
+{
+	const __m128i lut = _mm_loadu_si128((const __m128i*)table), mask = _mm_set1_epi8(0x0F);
+	size_t i = 0U;
+	for(; len - i >= 16U; i += 16U)
+	{
+		const __m128i input = _mm_loadu_si128((const __m128i*)(data + i));
+		const __m128i hi = _mm_and_si128(_mm_srli_epi16(input, 4), mask), lo = _mm_and_si128(input, mask);
+		_mm_storeu_si128((__m128i*)(out + (2U * i)),       _mm_shuffle_epi8(lut, _mm_unpacklo_epi8(hi, lo)));
+		_mm_storeu_si128((__m128i*)(out + (2U * i) + 16U), _mm_shuffle_epi8(lut, _mm_unpackhi_epi8(hi, lo)));
+	}
+	return i;
+}
+
+TARGET_AVX2 static size_t hex_avx2(char *const out, const uint8_t *const data, const size_t len, const char *const table)
+{
+	const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table)), mask = _mm256_set1_epi8(0x0F);
+	size_t i = 0U;
+	for(; len - i >= 32U; i += 32U)
+	{
+		const __m256i input = _mm256_loadu_si256((const __m256i*)(data + i));
+		const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(input, 4), mask), lo = _mm256_and_si256(input, mask);
+		const __m256i a = _mm256_unpacklo_epi8(hi, lo), b = _mm256_unpackhi_epi8(hi, lo); /*unpack works per 128-bit lane*/
+		_mm256_storeu_si256((__m256i*)(out + (2U * i)),       _mm256_shuffle_epi8(lut, _mm256_permute2x128_si256(a, b, 0x20)));
+		_mm256_storeu_si256((__m256i*)(out + (2U * i) + 32U), _mm256_shuffle_epi8(lut, _mm256_permute2x128_si256(a, b, 0x31)));
+	}
+	return i + hex_ssse3(out + (2U * i), data + i, len - i, table);
+}
+
+/*
+ * Base64: spread each group of 3 bytes over 4 bytes, extract the 6-bit indices with multiplications, and translate the
+ * indices to characters by adding an offset that is looked up with a byte shuffle (the alphabet consists of 5 ranges)
+ */
+#define BASE64_INDICES(SFX, IN) \
+	_mm##SFX##_or_si##IN( \
+		_mm##SFX##_mulhi_epu16(_mm##SFX##_and_si##IN(input, _mm##SFX##_set1_epi32(0x0FC0FC00)), _mm##SFX##_set1_epi32(0x04000040)), \
+		_mm##SFX##_mullo_epi16(_mm##SFX##_and_si##IN(input, _mm##SFX##_set1_epi32(0x003F03F0)), _mm##SFX##_set1_epi32(0x01000010)))
+
+#define BASE64_SHIFT_LUT(SET) SET('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0)
+
+TARGET_SSSE3 static size_t base64_ssse3(char *const out, const uint8_t *const data, const size_t len, const char *const)
+{
+	const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m128i shift_lut = BASE64_SHIFT_LUT(_mm_setr_epi8);
+	size_t i = 0U, j = 0U;
+	for(; len - i >= 16U; i += 12U, j += 16U)
+	{
+		const __m128i input = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i)), spread);
+		const __m128i indices = BASE64_INDICES(, 128);
+		const __m128i range = _mm_or_si128(_mm_subs_epu8(indices, _mm_set1_epi8(51)), _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+		_mm_storeu_si128((__m128i*)(out + j), _mm_add_epi8(indices, _mm_shuffle_epi8(shift_lut, range)));
+	}
+	return i;
+}
+
+TARGET_AVX2 static size_t base64_avx2(char *const out, const uint8_t *const data, const size_t len, const char *const table)
+{
+	const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i shift_lut = _mm256_broadcastsi128_si256(BASE64_SHIFT_LUT(_mm_setr_epi8));
+	size_t i = 0U, j = 0U;
+	for(; len - i >= 28U; i += 24U, j += 32U)
+	{
+		const __m256i loaded = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(data + i))), _mm_loadu_si128((const __m128i*)(data + i + 12U)), 1);
+		const __m256i input = _mm256_shuffle_epi8(loaded, spread);
+		const __m256i indices = BASE64_INDICES(256, 256);
+		const __m256i range = _mm256_or_si256(_mm256_subs_epu8(indices, _mm256_set1_epi8(51)), _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+		_mm256_storeu_si256((__m256i*)(out + j), _mm256_add_epi8(indices, _mm256_shuffle_epi8(shift_lut, range)));
+	}
+	return i + base64_ssse3(out + j, data + i, len - i, table);
+}
+
+#endif //ENCODE_DISPATCH
+
+/*
+ * Select the best SIMD encoders supported by the CPU, once
+ */
+typedef struct
+{
+	simd_encoder_t hex, base64;
+}
+simd_encoders_t;
+
+static simd_encoders_t select_encoders(void)
+{
+	simd_encoders_t encoders = { encode_none, encode_none };
+#ifdef ENCODE_DISPATCH
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	{
+		encoders.hex = hex_avx2;
+		encoders.base64 = base64_avx2;
+	}
+	else if(__builtin_cpu_supports("ssse3"))
+	{
+		encoders.hex = hex_ssse3;
+		encoders.base64 = base64_ssse3;
+	}
+#endif //ENCODE_DISPATCH
+	return encoders;
+}
+
+static const simd_encoders_t &get_encoders(void)
+{
+	static const simd_encoders_t encoders = select_encoders();
+	return encoders;
+}
+
+/*
+ * Convert byte array to Hex-string; the output buffer must hold HEX_LENGTH(len) + 1 characters
+ */
+size_t bytes_to_hex(char *const out, const uint8_t *const data, const size_t len, const bool lower_case)
 {
-	static const char *const HEXCHARS_UPR = "0123456789ABCDEF";
-	static const char *const HEXCHARS_LWR = "0123456789abcdef";
-	
 	const char *const hexchars = lower_case ? HEXCHARS_LWR : HEXCHARS_UPR;
-	std::ostringstream result;
-	
-	for(size_t i = 0U; i < len; ++i)
+	for(size_t i = get_encoders().hex(out, data, len, hexchars); i < len; ++i)
 	{
-		result << hexchars[(data[i] >> 4) & 0x0F];
-		result << hexchars[       data[i] & 0x0F];
+		out[(2U * i)     ] = hexchars[(data[i] >> 4) & 0x0F];
+		out[(2U * i) + 1U] = hexchars[ data[i]       & 0x0F];
 	}
-	
-	return result.str();
+
+	out[2U * len] = '\0';
+	return 2U * len;
 }
 
 /*
- * Convert byte array to Base64-string
+ * Convert byte array to Base64-string; the output buffer must hold BASE64_LENGTH(len) + 1 characters
  * implementation based on code created by Joe DF <https://github.com/joedf/base64.c>
  */
-std::string bytes_to_base64(const uint8_t *const data, const size_t len)
+size_t bytes_to_base64(char *const out, const uint8_t *const data, const size_t len)
 {
-	static const char *const B64CHARS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t i = get_encoders().base64(out, data, len, B64CHARS);
+	char *ptr = out + ((i / 3U) * 4U);
 
-	uint32_t s[3U];
-	std::ostringstream result;
-	
-	size_t j = 0U;
-	for (size_t i = 0U; i < len; ++i)
+	for(; len - i >= 3U; i += 3U)
+	{
+		const uint32_t s = (((uint32_t)data[i]) << 16U) | (((uint32_t)data[i + 1U]) << 8U) | ((uint32_t)data[i + 2U]);
+		*ptr++ = B64CHARS[(s >> 18U) & 0x3F];
+		*ptr++ = B64CHARS[(s >> 12U) & 0x3F];
+		*ptr++ = B64CHARS[(s >>  6U) & 0x3F];
+		*ptr++ = B64CHARS[ s         & 0x3F];
+	}
+
+	if (i < len)
 	{
-		s[j++] = data[i];
-		if (j >= 3U)
+		const uint32_t s0 = data[i], s1 = (len - i > 1U) ? data[i + 1U] : 0U;
+		*ptr++ = B64CHARS[s0 >> 2U];
+		*ptr++ = B64CHARS[((s0 & 0x03) << 4U) + ((s1 & 0xF0) >> 4U)];
+		*ptr++ = (len - i > 1U) ? B64CHARS[((s1 & 0x0F) << 2U)] : '=';
+		*ptr++ = '=';
+	}
+
+	*ptr = '\0';
+	return (size_t)(ptr - out);
+}
+
+/*
+ * Convert byte array to Base85-string; the output buffer must hold BASE85_LENGTH(len) + 1 characters
+ * implementation based on code created by Doug Currie <https://github.com/dcurrie/ascii85>
+ */
+static inline char *encode_base85_chunk(char *const out, uint32_t chunk)
+{
+	static const char BASE_CHAR = '!';
+	out[4U] = (char)(BASE_CHAR + (chunk % 85U)); chunk /= 85U;
+	out[3U] = (char)(BASE_CHAR + (chunk % 85U)); chunk /= 85U;
+	out[2U] = (char)(BASE_CHAR + (chunk % 85U)); chunk /= 85U;
+	out[1U] = (char)(BASE_CHAR + (chunk % 85U)); chunk /= 85U;
+	out[0U] = (char)(BASE_CHAR + chunk);
+	return out + 5U;
+}
+
+size_t bytes_to_base85(char *const out, const uint8_t *const data, const size_t len)
+{
+	char *ptr = out;
+	size_t pos = 0U;
+
+	for(; len - pos >= 4U; pos += 4U)
+	{
+		const uint32_t chunk = (((uint32_t)data[pos]) << 24U) | (((uint32_t)data[pos + 1U]) << 16U) | (((uint32_t)data[pos + 2U]) << 8U) | ((uint32_t)data[pos + 3U]);
+		if(chunk)
 		{
-			result << B64CHARS[ (s[0U] & 0xFF) >> 2U];
-			result << B64CHARS[((s[0U] & 0x03) << 4U) + ((s[1U] & 0xF0) >> 4U)];
-			result << B64CHARS[((s[1U] & 0x0F) << 2U) + ((s[2U] & 0xC0) >> 6U)];
-			result << B64CHARS[  s[2U] & 0x3F];
-			j = 0U;
+			ptr = encode_base85_chunk(ptr, chunk);
+		}
+		else
+		{
+			*ptr++ = 'z'; /*encode z for zero*/
 		}
 	}
-	
-	if (j > 0U)
+
+	if(pos < len)
 	{
-		if (j == 1U)
+		uint32_t chunk = 0U;
+		for(size_t shift = 24U; pos < len; shift -= 8U)
 		{
-			s[1U] = 0;
+			chunk |= ((uint32_t)data[pos++]) << shift;
 		}
-		result << B64CHARS[(s[0U] & 0xFF) >> 2U];
-		result << B64CHARS[((s[0U] & 0x03) << 4U) + ((s[1U] & 0xF0) >> 4U)];
-		result << ((j == 2U) ? B64CHARS[((s[1U] & 0x0F) << 2U)] : '=');
-		result << '=';
+		ptr = encode_base85_chunk(ptr, chunk); /*partial chunks are never abbreviated*/
 	}
 
-	return result.str();
+	*ptr = '\0';
+	return (size_t)(ptr - out);
 }
 
 /*
- * Convert byte array to Base85-string
- * implementation based on code created by Doug Currie <https://github.com/dcurrie/ascii85>
+ * Convert Hex-string to byte array; the string must encode exactly "len" bytes (upper-case or lower-case)
  */
-std::string bytes_to_base85(const uint8_t *const data, const size_t len)
+bool hex_to_bytes(const std::string &str, uint8_t *const data, const size_t len)
 {
-	static const char BASE_CHAR = '!';
+	if(str.length() != 2U * len)
+	{
+		return false;
+	}
 
-	size_t pos = 0U;
-	std::ostringstream result;
-	char temp[6U];
-	memset(temp, 0, sizeof(char) * 6U);
+	for(size_t i = 0U; i < str.length(); ++i)
+	{
+		const char c = str[i];
+		uint8_t value;
+		if((c >= '0') && (c <= '9'))
+		{
+			value = (uint8_t)(c - '0');
+		}
+		else if((c >= 'A') && (c <= 'F'))
+		{
+			value = (uint8_t)(c - 'A' + 10);
+		}
+		else if((c >= 'a') && (c <= 'f'))
+		{
+			value = (uint8_t)(c - 'a' + 10);
+		}
+		else
+		{
+			return false;
+		}
+		data[i / 2U] = (i & 1U) ? (data[i / 2U] | value) : (uint8_t)(value << 4U);
+	}
+
+	return true;
+}
 
-	while (pos < len)
+/*
+ * Convert Base64-string to byte array; the string must encode exactly "len" bytes
+ */
+bool base64_to_bytes(const std::string &str, uint8_t *const data, const size_t len)
+{
+	size_t length = str.length();
+	while((length > 0U) && (str[length - 1U] == '='))
+	{
+		--length; /*skip padding*/
+	}
+	if((length != ((4U * len) + 2U) / 3U) || (str.length() - length > 2U))
 	{
-		uint32_t chunk;
-		size_t n = len - pos;
+		return false;
+	}
 
-		if (n >= 4U)
+	uint32_t bits = 0U;
+	size_t count = 0U, pos = 0U;
+	for(size_t i = 0U; i < length; ++i)
+	{
+		const char c = str[i];
+		uint32_t value;
+		if((c >= 'A') && (c <= 'Z'))
+		{
+			value = (uint32_t)(c - 'A');
+		}
+		else if((c >= 'a') && (c <= 'z'))
+		{
+			value = (uint32_t)(c - 'a' + 26);
+		}
+		else if((c >= '0') && (c <= '9'))
+		{
+			value = (uint32_t)(c - '0' + 52);
+		}
+		else if((c == '+') || (c == '/'))
 		{
-			chunk  = (((uint32_t)data[pos++]) << 24U);
-			chunk |= (((uint32_t)data[pos++]) << 16U);
-			chunk |= (((uint32_t)data[pos++]) <<  8U);
-			chunk |= (((uint32_t)data[pos++]));
+			value = (c == '+') ? 62U : 63U;
 		}
 		else
 		{
-			chunk = (((uint32_t)data[pos++]) << 24U);
-			if (pos < len)
+			return false;
+		}
+		bits = (bits << 6U) | value;
+		if((count += 6U) >= 8U)
+		{
+			count -= 8U;
+			if(pos < len)
 			{
-				chunk |= (((uint32_t)data[pos++]) << 16U);
-				if (pos < len)
-				{
-					chunk |= (((uint32_t)data[pos++]) << 8U);
-					if (pos < len)
-					{
-						chunk |= (((uint32_t)data[pos++]));
-					}
-				}
+				data[pos++] = (uint8_t)(bits >> count);
 			}
 		}
+	}
 
-		if(chunk || (n < 4U))
+	return (pos == len);
+}
+
+/*
+ * Convert Base85-string to byte array, as created by bytes_to_base85(); the string must encode exactly "len" bytes
+ */
+bool base85_to_bytes(const std::string &str, uint8_t *const data, const size_t len)
+{
+	static const char BASE_CHAR = '!';
+
+	size_t pos = 0U, i = 0U;
+	while((i < str.length()) && (pos < len))
+	{
+		uint32_t chunk = 0U;
+		if(str[i] == 'z')
 		{
-			temp[4U] = ((char)(BASE_CHAR + (chunk % 85U)));
-			chunk /= 85U;
-			temp[3U] = ((char)(BASE_CHAR + (chunk % 85U)));
-			chunk /= 85U;
-			temp[2U] = ((char)(BASE_CHAR + (chunk % 85U)));
-			chunk /= 85U;
-			temp[1U] = ((char)(BASE_CHAR + (chunk % 85U)));
-			chunk /= 85U;
-			temp[0U] = ((char)(BASE_CHAR + chunk));
-			result << temp;
+			++i; /*z encodes zero*/
 		}
 		else
 		{
-			result << 'z'; /*encode z for zero*/
+			if(str.length() - i < 5U)
+			{
+				return false;
+			}
+			uint64_t value = 0U;
+			for(size_t j = 0U; j < 5U; ++j, ++i)
+			{
+				if((str[i] < BASE_CHAR) || (str[i] > (BASE_CHAR + 84)))
+				{
+					return false;
+				}
+				value = (value * 85U) + (uint64_t)(str[i] - BASE_CHAR);
+			}
+			if(value > UINT32_MAX)
+			{
+				return false;
+			}
+			chunk = (uint32_t)value;
+		}
+		for(size_t j = 0U; (j < 4U) && (pos < len); ++j)
+		{
+			data[pos++] = (uint8_t)(chunk >> (24U - (8U * j)));
 		}
 	}
 
-	return result.str();
+	return (pos == len) && (i == str.length());
 }
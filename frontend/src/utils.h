@@ -22,13 +22,26 @@
 #define INC_MHASH384_UTILS_H
 
 #include "common.h"
+#include "mhash384.h"
 #include <cstdlib>
 #include <cstdint>
 #include <string>
 
+/* Maximum number of characters created by the encoders, excluding the terminating NUL character */
+#define HEX_LENGTH(N)    (2U * (N))
+#define BASE64_LENGTH(N) (4U * (((N) + 2U) / 3U))
+#define BASE85_LENGTH(N) (5U * (((N) + 3U) / 4U))
+
+/* Buffer size that is sufficient for a digest string in any format */
+#define DIGEST_STRING_SIZE (HEX_LENGTH(MHASH384_SIZE) + 1U)
+
 const CHAR_T * get_basename(const CHAR_T *const path);
-std::string bytes_to_hex(const uint8_t *const data, const size_t len, const bool lower_case);
-std::string bytes_to_base64(const uint8_t *const data, const size_t len);
-std::string bytes_to_base85(const uint8_t *const data, const size_t len);
+bool glob_match(const CHAR_T *const pattern, const CHAR_T *const name);
+size_t bytes_to_hex(char *const out, const uint8_t *const data, const size_t len, const bool lower_case);
+size_t bytes_to_base64(char *const out, const uint8_t *const data, const size_t len);
+size_t bytes_to_base85(char *const out, const uint8_t *const data, const size_t len);
+bool hex_to_bytes(const std::string &str, uint8_t *const data, const size_t len);
+bool base64_to_bytes(const std::string &str, uint8_t *const data, const size_t len);
+bool base85_to_bytes(const std::string &str, uint8_t *const data, const size_t len);
 
 #endif /*INC_MHASH384_UTILS_H*/
@@ -40,6 +40,22 @@
 #define MHASH384_WORDS 6U
 #define MHASH384_SIZE (sizeof(uint64_t) * MHASH384_WORDS)
 
+/*
+ * MHash-384 multi-buffer lanes: 8 independent messages
+ */
+#define MHASH384_LANES 8U
+
+/*
+ * MHash-384 tree mode: 1 MiB leaves, up to 2^64 leaves
+ */
+#define MHASH384_TREE_LEAF_SIZE (1U << 20)
+#define MHASH384_TREE_DEPTH 64U
+
+/*
+ * MHash-384 usage statistics: histogram of the update sizes, by powers of two
+ */
+#define MHASH384_STATS_BUCKETS 16U
+
 /*
  * Enable "extern C" on C++ compilers
  */
@@ -59,6 +75,40 @@ typedef struct _mhash_384_t
 }
 mhash384_t;
 
+/*
+ * Context for multi-buffer hash computation: 8 lanes, stored as "structure of arrays"
+ */
+typedef struct _mhash_384_x8_t
+{
+	uint64_t hash[MHASH384_WORDS][MHASH384_LANES];
+	uint8_t rnd[MHASH384_LANES];
+}
+mhash384_x8_t;
+
+/*
+ * Context for tree hash computation: stack of pending sub-tree digests + counters
+ */
+typedef struct _mhash_384_tree_t
+{
+	uint64_t leaf_count;
+	uint64_t total_len;
+	uint8_t stack[MHASH384_TREE_DEPTH][MHASH384_SIZE];
+}
+mhash384_tree_t;
+
+/*
+ * Usage statistics; update_sizes[0] counts the calls with zero bytes, update_sizes[i] those with 2^(i-1) to 2^i-1
+ * bytes, and the last bucket all calls with 2^14 bytes or more
+ */
+typedef struct _mhash384_stats_t
+{
+	uint64_t bytes;          /*bytes hashed by any function*/
+	uint64_t update_calls;   /*calls of the update functions*/
+	uint64_t final_calls;    /*digests computed*/
+	uint64_t update_sizes[MHASH384_STATS_BUCKETS];
+}
+mhash384_stats_t;
+
 /*
  * MHash-384 public functions
  */
@@ -67,6 +117,34 @@ MHASH384_API void mhash384_update (mhash384_t *const ctx, const uint8_t *const d
 MHASH384_API void mhash384_final  (mhash384_t *const ctx, uint8_t *const digest_out);
 MHASH384_API void mhash384_compute(uint8_t *const digest_out, const uint8_t *const data_in, const size_t len);
 MHASH384_API void mhash384_version(uint16_t *const major, uint16_t *const minor, uint16_t *const patch);
+MHASH384_API const char *mhash384_kernel(void);
+
+/*
+ * MHash-384 multi-buffer functions
+ */
+MHASH384_API void mhash384_init_x8  (mhash384_x8_t *const ctx);
+MHASH384_API void mhash384_update_x8(mhash384_x8_t *const ctx, const uint8_t *const *const data_in, const size_t len);
+MHASH384_API void mhash384_final_x8 (mhash384_x8_t *const ctx, uint8_t *const *const digest_out);
+
+/*
+ * MHash-384 batch function
+ */
+MHASH384_API void mhash384_compute_batch(uint8_t (*const digests_out)[MHASH384_SIZE], const uint8_t *const *const data_in, const size_t *const len, const size_t count);
+
+/*
+ * MHash-384 tree mode functions
+ */
+MHASH384_API void mhash384_tree_init   (mhash384_tree_t *const ctx);
+MHASH384_API void mhash384_tree_leaf   (uint8_t *const digest_out, const uint8_t *const data_in, const size_t len);
+MHASH384_API void mhash384_tree_append (mhash384_tree_t *const ctx, const uint8_t *const leaf_digest, const size_t leaf_len);
+MHASH384_API void mhash384_tree_final  (mhash384_tree_t *const ctx, uint8_t *const digest_out);
+MHASH384_API void mhash384_tree_compute(uint8_t *const digest_out, const uint8_t *const data_in, const size_t len);
+
+/*
+ * MHash-384 usage statistics functions; only available, if the library was built with MHASH384_STATS=1
+ */
+MHASH384_API int  mhash384_stats_get  (mhash384_stats_t *const stats);
+MHASH384_API void mhash384_stats_reset(void);
 
 /*
  * MHash-384 self-test function
@@ -20,6 +20,8 @@
 
 #include "mhash384.h"
 #include <memory.h>
+#include <string.h>
+#include <stdio.h>
 
 /*
  * Version info
@@ -41,6 +43,50 @@
 #	define ALWAYS_INLINE
 #endif
 
+/*
+ * Runtime CPU dispatch (x86 only)
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && ((defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))) || (defined(__clang__) && ((__clang_major__ > 3) || ((__clang_major__ == 3) && (__clang_minor__ >= 9)))))
+#	define MHASH384_DISPATCH 1
+#	define TARGET_SSE42  __attribute__((target("sse4.2,popcnt")))
+#	define TARGET_AVX2   __attribute__((target("avx2")))
+#	define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512dq")))
+#	include <immintrin.h>
+#elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER) && (_MSC_VER >= 1910)
+#	define MHASH384_DISPATCH 1
+#	define TARGET_SSE42
+#	define TARGET_AVX2
+#	define TARGET_AVX512
+#	include <intrin.h>
+#endif
+
+/*
+ * Table layout: if non-zero, the ADD and XOR tables are interleaved into one table of cache-aligned 96-byte rows
+ */
+#ifndef MHASH384_FUSED_TABLES
+#	define MHASH384_FUSED_TABLES 1
+#endif
+
+/*
+ * Usage statistics: if non-zero, the public functions count the bytes, calls and update sizes, per thread
+ */
+#ifndef MHASH384_STATS
+#	define MHASH384_STATS 0
+#endif
+#if MHASH384_STATS
+#	include <atomic>
+#	include <mutex>
+#endif
+
+/*
+ * Keep the compiler from vectorizing the scalar kernel, which turned out to be a lot slower
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#	define NO_VECTORIZE __attribute__((optimize("no-tree-vectorize")))
+#else
+#	define NO_VECTORIZE
+#endif
+
 /*
  * Types
  */
@@ -70,7 +116,7 @@ static const ui64_t MHASH384_INI[MHASH384_WORDS] =
 /* Table XOR
  * 257x48 byte matrix containing pre-computed 384-bit words with HamD(a,b) >= 182 for each possible pair (a,b) with a != b
  */
-static const ui64_t MHASH384_XOR[257U][MHASH384_WORDS] =
+static constexpr ui64_t MHASH384_XOR[257U][MHASH384_WORDS] =
 {
 	{ 0x01DCDF00414B3037, 0xB1B3AF661B8E96F8, 0x944D2873DB393121, 0x73DA9A36662AE755, 0x1F4F318C4ECB56B1, 0xF09743D99C2AA5BC }, /*00*/
 	{ 0xA81FBBC6CBBFC954, 0x39DE43648959EDDB, 0x1A641A0BDA01822F, 0xB52E607266932658, 0x2C5B1731AC802084, 0xC2EF10671FC79DD4 }, /*01*/
@@ -334,7 +380,7 @@ static const ui64_t MHASH384_XOR[257U][MHASH384_WORDS] =
 /* Table ADD
  * 257x48 byte matrix containing pre-computed 384-bit words with HamD(a,b) >= 182 for each possible pair (a,b) with a != b
  */
-static const ui64_t MHASH384_ADD[257U][MHASH384_WORDS] =
+static constexpr ui64_t MHASH384_ADD[257U][MHASH384_WORDS] =
 {
 	{ 0x7D8058C289965A68, 0xA40E3AC93F6EEC96, 0x42962AB56A64DA88, 0xFB6391D25934AA91, 0xD9958F7E87AFCDCC, 0x988314D182C9F6F8 }, /*00*/
 	{ 0x1C460224D6627D46, 0x0C8338ED6877A302, 0x099686848A2D1E6B, 0x43B36D215D7BFB49, 0xB38786F894DB7C04, 0x6F4638AAE0B68B90 }, /*01*/
@@ -595,10 +641,60 @@ static const ui64_t MHASH384_ADD[257U][MHASH384_WORDS] =
 	{ 0x1D968E3B41E8C8BD, 0x52F0B3C77BEED767, 0xB916233D479F860A, 0xCEEB3FDA20E4BE56, 0xEB8F74A25AF28C6B, 0xBFC13FA4B59E4E49 }  /*ZZ*/
 };
 
+/*
+ * Compile-time index sequence 0, 1, ..., N-1, used to derive tables from the tables above
+ */
+template<size_t... I> struct index_list { };
+template<size_t N, size_t... I> struct make_index_list : make_index_list<N - 1U, N - 1U, I...> { };
+template<size_t... I> struct make_index_list<0U, I...> { typedef index_list<I...> type; };
+
+#if MHASH384_FUSED_TABLES
+
+/* Table ROW
+ * 257x96 byte matrix interleaving the rows of tables ADD and XOR, so that each round touches only two cache lines
+ */
+typedef struct
+{
+	ui64_t val_add[MHASH384_WORDS];
+	ui64_t val_xor[MHASH384_WORDS];
+}
+table_row_t;
+
+typedef struct alignas(64)
+{
+	table_row_t row[257U];
+}
+table_rows_t;
+
+static constexpr table_row_t make_row(const size_t i)
+{
+	return table_row_t
+	{
+		{ MHASH384_ADD[i][0U], MHASH384_ADD[i][1U], MHASH384_ADD[i][2U], MHASH384_ADD[i][3U], MHASH384_ADD[i][4U], MHASH384_ADD[i][5U] },
+		{ MHASH384_XOR[i][0U], MHASH384_XOR[i][1U], MHASH384_XOR[i][2U], MHASH384_XOR[i][3U], MHASH384_XOR[i][4U], MHASH384_XOR[i][5U] }
+	};
+}
+
+template<size_t... I> static constexpr table_rows_t make_rows(index_list<I...>)
+{
+	return table_rows_t { { make_row(I)... } };
+}
+
+static constexpr table_rows_t MHASH384_ROWS = make_rows(make_index_list<257U>::type());
+
+#	define TABLE_ADD(ROW) (MHASH384_ROWS.row[(ROW)].val_add)
+#	define TABLE_XOR(ROW) (MHASH384_ROWS.row[(ROW)].val_xor)
+#	define TABLE_SHIFT 5 /*row stride is 96 = 3 << 5 bytes*/
+#else
+#	define TABLE_ADD(ROW) (MHASH384_ADD[(ROW)])
+#	define TABLE_XOR(ROW) (MHASH384_XOR[(ROW)])
+#	define TABLE_SHIFT 4 /*row stride is 48 = 3 << 4 bytes*/
+#endif //MHASH384_FUSED_TABLES
+
 /* Table MIX
  * 257x6 matrix containing pre-computed mixing indices with HamD(a,b) >= 2 for each possible pair (a,b) with a != b
  */
-static const byte_t MHASH384_MIX[256U][MHASH384_WORDS] =
+static constexpr byte_t MHASH384_MIX[256U][MHASH384_WORDS] =
 {
 	{ 0x05, 0x03, 0x04, 0x01, 0x02, 0x00 }, /*00*/
 	{ 0x02, 0x05, 0x00, 0x04, 0x03, 0x01 }, /*01*/
@@ -858,6 +954,29 @@ static const byte_t MHASH384_MIX[256U][MHASH384_WORDS] =
 	{ 0x01, 0x04, 0x00, 0x05, 0x03, 0x02 }  /*FF*/
 };
 
+#ifdef MHASH384_DISPATCH
+
+/* Table MIX_IDX
+ * 256x8 matrix containing the indices of table MIX, padded to eight lanes, to be used as permutation vectors
+ */
+typedef struct
+{
+	byte_t row[256U][8U];
+}
+mix_index_t;
+
+template<size_t... I> static constexpr mix_index_t make_mix_index(index_list<I...>)
+{
+	return mix_index_t
+	{
+		{ { MHASH384_MIX[I][0U], MHASH384_MIX[I][1U], MHASH384_MIX[I][2U], MHASH384_MIX[I][3U], MHASH384_MIX[I][4U], MHASH384_MIX[I][5U], 6U, 7U }... }
+	};
+}
+
+static constexpr mix_index_t MHASH384_MIX_IDX = make_mix_index(make_index_list<256U>::type());
+
+#endif //MHASH384_DISPATCH
+
 /* Table FIN
  * 48 entries vector containing pre-computed indices to be used for extracting the final digest
  */
@@ -908,44 +1027,109 @@ static byte_t ALWAYS_INLINE get_byte(const ui64_t *const hash, const byte_t idx)
 while(0)
 
 /* ======================================================================== */
-/* PUBLIC FUNCTIONS                                                         */
+/* SCALAR KERNELS                                                           */
 /* ======================================================================== */
 
 /*
- * Initialize hash computation
+ * Process a single round, using an explicit table row
  */
-void mhash384_init(mhash384_t *const ctx)
+static ALWAYS_INLINE void round_kernel(mhash384_t *const ctx, const ui16_t row)
 {
-	ctx->rnd = 0U;
-	memcpy(ctx->hash, MHASH384_INI, MHASH384_SIZE);
+	const ui64_t *const p_xor = TABLE_XOR(row);
+	const ui64_t *const p_add = TABLE_ADD(row);
+	const byte_t *const p_mix = MHASH384_MIX[ctx->rnd++];
+	MHASH384_UPDATE();
 }
 
 /*
- * Process next block of input data
+ * Process a single round with a compile-time MIX row; the state words are only ever addressed by constant indices,
+ * so that the compiler can keep them in registers and the permutation turns into plain register renaming
  */
-void mhash384_update(mhash384_t *const ctx, const byte_t *const data_in, const size_t len)
+template<size_t RND> static ALWAYS_INLINE void unrolled_round(ui64_t *const h, const byte_t value)
 {
-	size_t i;
-	for(i = 0U; i < len; ++i)
+	enum
 	{
-		const ui64_t *const p_xor = MHASH384_XOR[data_in[i]];
-		const ui64_t *const p_add = MHASH384_ADD[data_in[i]];
-		const byte_t *const p_mix = MHASH384_MIX[ctx->rnd++];
-		MHASH384_UPDATE();
+		MIX_0 = MHASH384_MIX[RND][0U], MIX_1 = MHASH384_MIX[RND][1U], MIX_2 = MHASH384_MIX[RND][2U],
+		MIX_3 = MHASH384_MIX[RND][3U], MIX_4 = MHASH384_MIX[RND][4U], MIX_5 = MHASH384_MIX[RND][5U]
+	};
+	const ui64_t *const p_xor = TABLE_XOR(value);
+	const ui64_t *const p_add = TABLE_ADD(value);
+	const ui64_t temp_0 = mix128to64(h[0U] + p_add[0U], h[MIX_0]) ^ p_xor[0U];
+	const ui64_t temp_1 = mix128to64(h[1U] + p_add[1U], h[MIX_1]) ^ p_xor[1U];
+	const ui64_t temp_2 = mix128to64(h[2U] + p_add[2U], h[MIX_2]) ^ p_xor[2U];
+	const ui64_t temp_3 = mix128to64(h[3U] + p_add[3U], h[MIX_3]) ^ p_xor[3U];
+	const ui64_t temp_4 = mix128to64(h[4U] + p_add[4U], h[MIX_4]) ^ p_xor[4U];
+	const ui64_t temp_5 = mix128to64(h[5U] + p_add[5U], h[MIX_5]) ^ p_xor[5U];
+	h[0U] = temp_0; h[1U] = temp_1; h[2U] = temp_2;
+	h[3U] = temp_3; h[4U] = temp_4; h[5U] = temp_5;
+}
+
+/*
+ * Process the first "N" rounds of a 256-round cycle, i.e. rounds 0 to N-1, fully unrolled
+ */
+template<size_t N> struct unrolled_rounds
+{
+	static ALWAYS_INLINE void run(ui64_t *const h, const byte_t *const data_in)
+	{
+		unrolled_rounds<N - 1U>::run(h, data_in);
+		unrolled_round<N - 1U>(h, data_in[N - 1U]);
+	}
+};
+
+template<> struct unrolled_rounds<0U>
+{
+	static ALWAYS_INLINE void run(ui64_t *const, const byte_t *const) { }
+};
+
+/*
+ * Process "count" whole 256-byte blocks, starting at round 0, keeping the state in local variables and writing it back
+ * only once; this is shared by all scalar kernels, because the instruction set makes no difference here
+ */
+static NO_VECTORIZE void update_blocks(mhash384_t *const ctx, const byte_t *data_in, size_t count)
+{
+	ui64_t h[MHASH384_WORDS];
+	memcpy(h, ctx->hash, MHASH384_SIZE);
+	for(; count > 0U; --count, data_in += 256U)
+	{
+		unrolled_rounds<256U>::run(h, data_in);
+	}
+	memcpy(ctx->hash, h, MHASH384_SIZE);
+}
+
+/*
+ * Process next block of input data; once the round counter has wrapped around, whole 256-byte blocks are passed
+ * to the unrolled rounds
+ */
+static ALWAYS_INLINE void update_kernel(mhash384_t *const ctx, const byte_t *const data_in, const size_t len)
+{
+	const size_t lead = (256U - ctx->rnd) & 0xFFU;
+	size_t i = 0U;
+	if(len >= lead + 256U)
+	{
+		for(; i < lead; ++i)
+		{
+			round_kernel(ctx, data_in[i]);
+		}
+		update_blocks(ctx, data_in + i, (len - i) / 256U);
+		i += (len - i) & ~((size_t)0xFFU);
+	}
+	for(; i < len; ++i)
+	{
+		round_kernel(ctx, data_in[i]);
 	}
 }
 
 /*
  * Compute the final hash value
  */
-void mhash384_final(mhash384_t *const ctx, byte_t *const digest_out)
+static ALWAYS_INLINE void final_kernel(mhash384_t *const ctx, byte_t *const digest_out)
 {
 	ui16_t prev_value = 256U;
 	size_t i;
 	for(i = 0U; i < MHASH384_SIZE; ++i)
 	{
-		const ui64_t *const p_xor = MHASH384_XOR[prev_value];
-		const ui64_t *const p_add = MHASH384_ADD[prev_value];
+		const ui64_t *const p_xor = TABLE_XOR(prev_value);
+		const ui64_t *const p_add = TABLE_ADD(prev_value);
 		const byte_t *const p_mix = MHASH384_MIX[ctx->rnd++];
 		MHASH384_UPDATE();
 		prev_value = digest_out[i] = get_byte(ctx->hash, MHASH384_FIN[i]);
@@ -953,14 +1137,1248 @@ void mhash384_final(mhash384_t *const ctx, byte_t *const digest_out)
 }
 
 /*
- * Get hash value for given input at once
+ * Instantiate the scalar kernels for a specific instruction set
  */
-void mhash384_compute(byte_t *const digest_out, const byte_t *const data_in, const size_t len)
+#define MHASH384_SCALAR_KERNELS(NAME, TARGET) \
+	static TARGET NO_VECTORIZE void update_##NAME(mhash384_t *const ctx, const byte_t *const data_in, const size_t len) \
+	{ \
+		update_kernel(ctx, data_in, len); \
+	} \
+	static TARGET NO_VECTORIZE void final_##NAME(mhash384_t *const ctx, byte_t *const digest_out) \
+	{ \
+		final_kernel(ctx, digest_out); \
+	}
+
+MHASH384_SCALAR_KERNELS(generic, )
+
+#ifdef MHASH384_DISPATCH
+MHASH384_SCALAR_KERNELS(sse42,  TARGET_SSE42)
+MHASH384_SCALAR_KERNELS(avx2,   TARGET_AVX2)
+MHASH384_SCALAR_KERNELS(avx512, TARGET_AVX512)
+#endif //MHASH384_DISPATCH
+
+/* ======================================================================== */
+/* MULTI-BUFFER KERNELS                                                     */
+/* ======================================================================== */
+
+/*
+ * Copy a single lane from/to the multi-buffer context
+ */
+static ALWAYS_INLINE void lane_load(mhash384_t *const ctx, const mhash384_x8_t *const ctx_x8, const size_t lane)
 {
-	mhash384_t ctx; /*transient ctx*/
-	mhash384_init  (&ctx);
-	mhash384_update(&ctx, data_in, len);
-	mhash384_final (&ctx, digest_out);
+	size_t j;
+	ctx->rnd = ctx_x8->rnd[lane];
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		ctx->hash[j] = ctx_x8->hash[j][lane];
+	}
+}
+
+static ALWAYS_INLINE void lane_store(mhash384_x8_t *const ctx_x8, const mhash384_t *const ctx, const size_t lane)
+{
+	size_t j;
+	ctx_x8->rnd[lane] = ctx->rnd;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		ctx_x8->hash[j][lane] = ctx->hash[j];
+	}
+}
+
+/*
+ * Check whether all lanes are at the same round
+ */
+static ALWAYS_INLINE int lanes_uniform(const mhash384_x8_t *const ctx_x8)
+{
+	size_t lane;
+	for(lane = 1U; lane < MHASH384_LANES; ++lane)
+	{
+		if(ctx_x8->rnd[lane] != ctx_x8->rnd[0U])
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+#ifdef MHASH384_DISPATCH
+
+/*
+ * CityHash 128-Bit to 64-Bit mixing function, 8 lanes at once (AVX-512)
+ */
+static TARGET_AVX512 ALWAYS_INLINE __m512i mix128to64_x8(const __m512i u, __m512i v)
+{
+	const __m512i kmul = _mm512_set1_epi64((long long)KMUL);
+	v = _mm512_mullo_epi64(_mm512_xor_si512(v, u), kmul);
+	v = _mm512_xor_si512(v, _mm512_srli_epi64(v, 47));
+	v = _mm512_mullo_epi64(_mm512_xor_si512(v, u), kmul);
+	v = _mm512_xor_si512(v, _mm512_srli_epi64(v, 47));
+	return _mm512_mullo_epi64(v, kmul);
+}
+
+/*
+ * Load the next (up to) 8 input bytes of each lane; byte #k ends up in bits [8k, 8k+7]
+ */
+static TARGET_AVX512 ALWAYS_INLINE __m512i load_x8(const byte_t *const *const data_in, const size_t pos, const size_t count)
+{
+	ui64_t word[MHASH384_LANES];
+	size_t lane;
+	for(lane = 0U; lane < MHASH384_LANES; ++lane)
+	{
+		word[lane] = 0U;
+		memcpy(&word[lane], data_in[lane] + pos, count);
+	}
+	return _mm512_loadu_si512(word);
+}
+
+/*
+ * Apply next "ADD-then-MIX-then-XOR" iteration on all lanes; src[] holds the MIX source words
+ */
+static TARGET_AVX512 ALWAYS_INLINE void apply_x8(__m512i *const h, const __m512i *const src, const __m512i row)
+{
+	const __m512i offset = _mm512_add_epi64(_mm512_slli_epi64(row, TABLE_SHIFT + 1), _mm512_slli_epi64(row, TABLE_SHIFT)); /*row * stride*/
+	size_t j;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		const __m512i p_add = _mm512_i64gather_epi64(offset, &TABLE_ADD(0U)[j], 1);
+		const __m512i p_xor = _mm512_i64gather_epi64(offset, &TABLE_XOR(0U)[j], 1);
+		h[j] = _mm512_xor_si512(mix128to64_x8(_mm512_add_epi64(src[j], p_add), src[MHASH384_WORDS + j]), p_xor);
+	}
+}
+
+/*
+ * Process next round, all lanes at the same round
+ */
+static TARGET_AVX512 ALWAYS_INLINE void update_x8(__m512i *const h, const __m512i row, const byte_t *const p_mix)
+{
+	__m512i src[2U * MHASH384_WORDS];
+	size_t j;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		src[j] = h[j];
+		src[MHASH384_WORDS + j] = h[p_mix[j]];
+	}
+	apply_x8(h, src, row);
+}
+
+/*
+ * Process next round, each lane at its own round (rnd holds one round counter per lane)
+ */
+static TARGET_AVX512 ALWAYS_INLINE void update_x8_lanes(__m512i *const h, const __m512i row, __m512i *const rnd)
+{
+	const __m512i mask = _mm512_set1_epi64(0xFF);
+	const __m512i base = _mm512_add_epi64(_mm512_slli_epi64(*rnd, 2), _mm512_slli_epi64(*rnd, 1)); /*rnd * 6*/
+	const __m512i mix_lo = _mm512_cvtepu32_epi64(_mm512_i64gather_epi32(base, MHASH384_MIX, 1));
+	const __m512i mix_hi = _mm512_cvtepu32_epi64(_mm512_i64gather_epi32(_mm512_add_epi64(base, _mm512_set1_epi64(2)), MHASH384_MIX, 1));
+	__m512i src[2U * MHASH384_WORDS];
+	size_t j, k;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		const __m512i idx = _mm512_and_si512((j < 4U) ? _mm512_srli_epi64(mix_lo, 8U * j) : _mm512_srli_epi64(mix_hi, 8U * (j - 2U)), mask);
+		src[j] = h[j];
+		src[MHASH384_WORDS + j] = h[0U];
+		for(k = 1U; k < MHASH384_WORDS; ++k)
+		{
+			src[MHASH384_WORDS + j] = _mm512_mask_blend_epi64(_mm512_cmpeq_epi64_mask(idx, _mm512_set1_epi64(k)), src[MHASH384_WORDS + j], h[k]);
+		}
+	}
+	apply_x8(h, src, row);
+	*rnd = _mm512_and_si512(_mm512_add_epi64(*rnd, _mm512_set1_epi64(1)), mask);
+}
+
+/*
+ * Process input data on all lanes (AVX-512)
+ */
+static TARGET_AVX512 void update_x8_avx512(mhash384_x8_t *const ctx, const byte_t *const *const data_in, const size_t len)
+{
+	const __m512i mask = _mm512_set1_epi64(0xFF);
+	const int uniform = lanes_uniform(ctx);
+	__m512i h[MHASH384_WORDS], rnd = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)ctx->rnd));
+	byte_t rnd_0 = ctx->rnd[0U];
+	size_t i, j, pos;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		h[j] = _mm512_loadu_si512(ctx->hash[j]);
+	}
+	for(pos = 0U; pos < len; pos += 8U)
+	{
+		const size_t count = ((len - pos) < 8U) ? (len - pos) : 8U;
+		__m512i input = load_x8(data_in, pos, count);
+		for(i = 0U; i < count; ++i)
+		{
+			const __m512i row = _mm512_and_si512(input, mask);
+			if(uniform)
+			{
+				update_x8(h, row, MHASH384_MIX[rnd_0++]);
+			}
+			else
+			{
+				update_x8_lanes(h, row, &rnd);
+			}
+			input = _mm512_srli_epi64(input, 8);
+		}
+	}
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		_mm512_storeu_si512(ctx->hash[j], h[j]);
+	}
+	for(i = 0U; i < MHASH384_LANES; ++i)
+	{
+		ctx->rnd[i] = (byte_t)(ctx->rnd[i] + len);
+	}
+}
+
+/*
+ * Compute the final hash values of all lanes (AVX-512)
+ */
+static TARGET_AVX512 void final_x8_avx512(mhash384_x8_t *const ctx, byte_t *const *const digest_out)
+{
+	const __m512i mask = _mm512_set1_epi64(0xFF);
+	const int uniform = lanes_uniform(ctx);
+	__m512i h[MHASH384_WORDS], rnd = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)ctx->rnd));
+	__m512i prev_value = _mm512_set1_epi64(256);
+	byte_t rnd_0 = ctx->rnd[0U];
+	ui64_t value[MHASH384_LANES];
+	size_t i, j;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		h[j] = _mm512_loadu_si512(ctx->hash[j]);
+	}
+	for(i = 0U; i < MHASH384_SIZE; ++i)
+	{
+		if(uniform)
+		{
+			update_x8(h, prev_value, MHASH384_MIX[rnd_0++]);
+		}
+		else
+		{
+			update_x8_lanes(h, prev_value, &rnd);
+		}
+		prev_value = _mm512_and_si512(_mm512_srl_epi64(h[MHASH384_FIN[i] / 8U], _mm_cvtsi32_si128((MHASH384_FIN[i] % 8U) * 8U)), mask);
+		_mm512_storeu_si512(value, prev_value);
+		for(j = 0U; j < MHASH384_LANES; ++j)
+		{
+			digest_out[j][i] = (byte_t)value[j];
+		}
+	}
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		_mm512_storeu_si512(ctx->hash[j], h[j]);
+	}
+	for(i = 0U; i < MHASH384_LANES; ++i)
+	{
+		ctx->rnd[i] = (byte_t)(ctx->rnd[i] + MHASH384_SIZE);
+	}
+}
+
+/*
+ * Process "n" rounds on all lanes; finalizing lanes (fin_mask) feed back their digest bytes instead of input data (AVX-512)
+ */
+static TARGET_AVX512 void rounds_x8_avx512(mhash384_x8_t *const ctx, const byte_t *const *const data_in, byte_t *const *const digest_out, const byte_t (*const fin_idx)[MHASH384_LANES], ui16_t *const row, const byte_t fin_mask, const size_t n)
+{
+	const __m512i mask = _mm512_set1_epi64(0xFF);
+	const int uniform = lanes_uniform(ctx);
+	__m512i h[MHASH384_WORDS], rnd = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)ctx->rnd));
+	__m512i prev_value = _mm512_cvtepu16_epi64(_mm_loadu_si128((const __m128i*)row));
+	byte_t rnd_0 = ctx->rnd[0U];
+	ui64_t value[MHASH384_LANES];
+	size_t i, j, pos;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		h[j] = _mm512_loadu_si512(ctx->hash[j]);
+	}
+	for(pos = 0U; pos < n; pos += 8U)
+	{
+		const size_t count = ((n - pos) < 8U) ? (n - pos) : 8U;
+		__m512i input = load_x8(data_in, pos, count);
+		for(i = pos; i < pos + count; ++i)
+		{
+			const __m512i fin = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)fin_idx[i]));
+			const __m512i word_idx = _mm512_srli_epi64(fin, 3), shift = _mm512_slli_epi64(_mm512_and_si512(fin, _mm512_set1_epi64(7)), 3);
+			if(uniform)
+			{
+				update_x8(h, _mm512_mask_blend_epi64(fin_mask, _mm512_and_si512(input, mask), prev_value), MHASH384_MIX[rnd_0++]);
+			}
+			else
+			{
+				update_x8_lanes(h, _mm512_mask_blend_epi64(fin_mask, _mm512_and_si512(input, mask), prev_value), &rnd);
+			}
+			__m512i word = h[0U];
+			for(j = 1U; j < MHASH384_WORDS; ++j)
+			{
+				word = _mm512_mask_blend_epi64(_mm512_cmpeq_epi64_mask(word_idx, _mm512_set1_epi64(j)), word, h[j]);
+			}
+			prev_value = _mm512_and_si512(_mm512_srlv_epi64(word, shift), mask);
+			_mm512_storeu_si512(value, prev_value);
+			for(j = 0U; j < MHASH384_LANES; ++j)
+			{
+				digest_out[j][i] = (byte_t)value[j];
+			}
+			input = _mm512_srli_epi64(input, 8);
+		}
+	}
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		_mm512_storeu_si512(ctx->hash[j], h[j]);
+	}
+	_mm512_storeu_si512(value, prev_value);
+	for(j = 0U; j < MHASH384_LANES; ++j)
+	{
+		ctx->rnd[j] = (byte_t)(ctx->rnd[j] + n);
+		row[j] = (ui16_t)value[j];
+	}
+}
+
+/*
+ * 64x64 to 64-Bit multiplication, emulated from 32x32 to 64-Bit partial products (AVX2)
+ */
+static TARGET_AVX2 ALWAYS_INLINE __m256i mullo_x4(const __m256i a, const __m256i b_lo, const __m256i b_hi)
+{
+	const __m256i lo_lo = _mm256_mul_epu32(a, b_lo);
+	const __m256i hi_lo = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo);
+	const __m256i lo_hi = _mm256_mul_epu32(a, b_hi);
+	return _mm256_add_epi64(lo_lo, _mm256_slli_epi64(_mm256_add_epi64(hi_lo, lo_hi), 32));
+}
+
+/*
+ * CityHash 128-Bit to 64-Bit mixing function, 4 lanes at once (AVX2)
+ */
+static TARGET_AVX2 ALWAYS_INLINE __m256i mix128to64_x4(const __m256i u, __m256i v)
+{
+	const __m256i kmul_lo = _mm256_set1_epi64x((long long)(KMUL & 0xFFFFFFFF));
+	const __m256i kmul_hi = _mm256_set1_epi64x((long long)(KMUL >> 32U));
+	v = mullo_x4(_mm256_xor_si256(v, u), kmul_lo, kmul_hi);
+	v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 47));
+	v = mullo_x4(_mm256_xor_si256(v, u), kmul_lo, kmul_hi);
+	v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 47));
+	return mullo_x4(v, kmul_lo, kmul_hi);
+}
+
+/*
+ * Load the next (up to) 8 input bytes of each lane; byte #k ends up in bits [8k, 8k+7]
+ */
+static TARGET_AVX2 ALWAYS_INLINE __m256i load_x4(const byte_t *const *const data_in, const size_t pos, const size_t count)
+{
+	ui64_t word[4U];
+	size_t lane;
+	for(lane = 0U; lane < 4U; ++lane)
+	{
+		word[lane] = 0U;
+		memcpy(&word[lane], data_in[lane] + pos, count);
+	}
+	return _mm256_loadu_si256((const __m256i*)word);
+}
+
+/*
+ * Apply next "ADD-then-MIX-then-XOR" iteration on four lanes; src[] holds the MIX source words
+ */
+static TARGET_AVX2 ALWAYS_INLINE void apply_x4(__m256i *const h, const __m256i *const src, const __m256i row)
+{
+	const __m256i offset = _mm256_add_epi64(_mm256_slli_epi64(row, TABLE_SHIFT + 1), _mm256_slli_epi64(row, TABLE_SHIFT)); /*row * stride*/
+	size_t j;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		const __m256i p_add = _mm256_i64gather_epi64((const long long*)&TABLE_ADD(0U)[j], offset, 1);
+		const __m256i p_xor = _mm256_i64gather_epi64((const long long*)&TABLE_XOR(0U)[j], offset, 1);
+		h[j] = _mm256_xor_si256(mix128to64_x4(_mm256_add_epi64(src[j], p_add), src[MHASH384_WORDS + j]), p_xor);
+	}
+}
+
+/*
+ * Process next round, all lanes at the same round
+ */
+static TARGET_AVX2 ALWAYS_INLINE void update_x4(__m256i *const h, const __m256i row, const byte_t *const p_mix)
+{
+	__m256i src[2U * MHASH384_WORDS];
+	size_t j;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		src[j] = h[j];
+		src[MHASH384_WORDS + j] = h[p_mix[j]];
+	}
+	apply_x4(h, src, row);
+}
+
+/*
+ * Process next round, each lane at its own round (rnd holds one round counter per lane)
+ */
+static TARGET_AVX2 ALWAYS_INLINE void update_x4_lanes(__m256i *const h, const __m256i row, __m256i *const rnd)
+{
+	const __m256i mask = _mm256_set1_epi64x(0xFF);
+	const __m256i base = _mm256_add_epi64(_mm256_slli_epi64(*rnd, 2), _mm256_slli_epi64(*rnd, 1)); /*rnd * 6*/
+	const __m256i mix_lo = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32((const int*)MHASH384_MIX, base, 1));
+	const __m256i mix_hi = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32((const int*)MHASH384_MIX, _mm256_add_epi64(base, _mm256_set1_epi64x(2)), 1));
+	__m256i src[2U * MHASH384_WORDS];
+	size_t j, k;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		const __m256i idx = _mm256_and_si256((j < 4U) ? _mm256_srli_epi64(mix_lo, 8U * j) : _mm256_srli_epi64(mix_hi, 8U * (j - 2U)), mask);
+		src[j] = h[j];
+		src[MHASH384_WORDS + j] = h[0U];
+		for(k = 1U; k < MHASH384_WORDS; ++k)
+		{
+			src[MHASH384_WORDS + j] = _mm256_blendv_epi8(src[MHASH384_WORDS + j], h[k], _mm256_cmpeq_epi64(idx, _mm256_set1_epi64x(k)));
+		}
+	}
+	apply_x4(h, src, row);
+	*rnd = _mm256_and_si256(_mm256_add_epi64(*rnd, _mm256_set1_epi64x(1)), mask);
+}
+
+/*
+ * Load/store four lanes of the multi-buffer context, starting at lane "first"
+ */
+static TARGET_AVX2 ALWAYS_INLINE void load_state_x4(__m256i *const h, __m256i *const rnd, const mhash384_x8_t *const ctx, const size_t first)
+{
+	ui32_t rnd_x4;
+	size_t j;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		h[j] = _mm256_loadu_si256((const __m256i*)&ctx->hash[j][first]);
+	}
+	memcpy(&rnd_x4, &ctx->rnd[first], sizeof(ui32_t));
+	*rnd = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128((int)rnd_x4));
+}
+
+static TARGET_AVX2 ALWAYS_INLINE void store_state_x4(mhash384_x8_t *const ctx, const __m256i *const h, const size_t first, const size_t len)
+{
+	size_t j;
+	for(j = 0U; j < MHASH384_WORDS; ++j)
+	{
+		_mm256_storeu_si256((__m256i*)&ctx->hash[j][first], h[j]);
+	}
+	for(j = first; j < first + 4U; ++j)
+	{
+		ctx->rnd[j] = (byte_t)(ctx->rnd[j] + len);
+	}
+}
+
+/*
+ * Process input data on four lanes, starting at lane "first" (AVX2); "uniform" must be determined for all lanes
+ * before the first group is processed, because processing a group advances its round counters
+ */
+static TARGET_AVX2 void update_x4_avx2(mhash384_x8_t *const ctx, const byte_t *const *const data_in, const size_t len, const size_t first, const int uniform)
+{
+	const __m256i mask = _mm256_set1_epi64x(0xFF);
+	__m256i h[MHASH384_WORDS], rnd;
+	byte_t rnd_0 = ctx->rnd[first];
+	size_t i, pos;
+	load_state_x4(h, &rnd, ctx, first);
+	for(pos = 0U; pos < len; pos += 8U)
+	{
+		const size_t count = ((len - pos) < 8U) ? (len - pos) : 8U;
+		__m256i input = load_x4(data_in + first, pos, count);
+		for(i = 0U; i < count; ++i)
+		{
+			const __m256i row = _mm256_and_si256(input, mask);
+			if(uniform)
+			{
+				update_x4(h, row, MHASH384_MIX[rnd_0++]);
+			}
+			else
+			{
+				update_x4_lanes(h, row, &rnd);
+			}
+			input = _mm256_srli_epi64(input, 8);
+		}
+	}
+	store_state_x4(ctx, h, first, len);
+}
+
+/*
+ * Compute the final hash values of four lanes, starting at lane "first" (AVX2)
+ */
+static TARGET_AVX2 void final_x4_avx2(mhash384_x8_t *const ctx, byte_t *const *const digest_out, const size_t first, const int uniform)
+{
+	const __m256i mask = _mm256_set1_epi64x(0xFF);
+	__m256i h[MHASH384_WORDS], rnd, prev_value = _mm256_set1_epi64x(256);
+	byte_t rnd_0 = ctx->rnd[first];
+	ui64_t value[4U];
+	size_t i, j;
+	load_state_x4(h, &rnd, ctx, first);
+	for(i = 0U; i < MHASH384_SIZE; ++i)
+	{
+		if(uniform)
+		{
+			update_x4(h, prev_value, MHASH384_MIX[rnd_0++]);
+		}
+		else
+		{
+			update_x4_lanes(h, prev_value, &rnd);
+		}
+		prev_value = _mm256_and_si256(_mm256_srl_epi64(h[MHASH384_FIN[i] / 8U], _mm_cvtsi32_si128((MHASH384_FIN[i] % 8U) * 8U)), mask);
+		_mm256_storeu_si256((__m256i*)value, prev_value);
+		for(j = 0U; j < 4U; ++j)
+		{
+			digest_out[first + j][i] = (byte_t)value[j];
+		}
+	}
+	store_state_x4(ctx, h, first, MHASH384_SIZE);
+}
+
+#endif //MHASH384_DISPATCH
+
+/*
+ * Process input data on all lanes, one lane at a time (generic)
+ */
+static void update_x8_generic(mhash384_x8_t *const ctx, const byte_t *const *const data_in, const size_t len)
+{
+	mhash384_t lane_ctx;
+	size_t lane;
+	for(lane = 0U; lane < MHASH384_LANES; ++lane)
+	{
+		lane_load(&lane_ctx, ctx, lane);
+		update_generic(&lane_ctx, data_in[lane], len);
+		lane_store(ctx, &lane_ctx, lane);
+	}
+}
+
+/*
+ * Compute the final hash values of all lanes, one lane at a time (generic)
+ */
+static void final_x8_generic(mhash384_x8_t *const ctx, byte_t *const *const digest_out)
+{
+	mhash384_t lane_ctx;
+	size_t lane;
+	for(lane = 0U; lane < MHASH384_LANES; ++lane)
+	{
+		lane_load(&lane_ctx, ctx, lane);
+		final_generic(&lane_ctx, digest_out[lane]);
+		lane_store(ctx, &lane_ctx, lane);
+	}
+}
+
+#ifdef MHASH384_DISPATCH
+
+/*
+ * Process all eight lanes as two groups of four lanes (AVX2)
+ */
+static void update_x8_avx2(mhash384_x8_t *const ctx, const byte_t *const *const data_in, const size_t len)
+{
+	const int uniform = lanes_uniform(ctx);
+	update_x4_avx2(ctx, data_in, len, 0U, uniform);
+	update_x4_avx2(ctx, data_in, len, 4U, uniform);
+}
+
+static void final_x8_avx2(mhash384_x8_t *const ctx, byte_t *const *const digest_out)
+{
+	const int uniform = lanes_uniform(ctx);
+	final_x4_avx2(ctx, digest_out, 0U, uniform);
+	final_x4_avx2(ctx, digest_out, 4U, uniform);
+}
+
+#endif //MHASH384_DISPATCH
+
+/* ======================================================================== */
+/* SINGLE-STREAM SIMD KERNELS                                               */
+/* ======================================================================== */
+
+#ifdef MHASH384_DISPATCH
+
+/*
+ * Apply next "ADD-then-MIX-then-XOR" iteration, holding the six words in the lower lanes of a single ZMM register;
+ * the MIX step is a permutation of the lanes
+ */
+static TARGET_AVX512 ALWAYS_INLINE __m512i round_x1(const __m512i h, const ui16_t row, const byte_t rnd)
+{
+	const __m512i idx = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)MHASH384_MIX_IDX.row[rnd]));
+	const __m512i p_add = _mm512_maskz_loadu_epi64(0x3F, TABLE_ADD(row));
+	const __m512i p_xor = _mm512_maskz_loadu_epi64(0x3F, TABLE_XOR(row));
+	return _mm512_xor_si512(mix128to64_x8(_mm512_add_epi64(h, p_add), _mm512_permutexvar_epi64(idx, h)), p_xor);
+}
+
+/*
+ * Process next block of input data (AVX-512, single stream)
+ */
+static TARGET_AVX512 void update_avx512v(mhash384_t *const ctx, const byte_t *const data_in, const size_t len)
+{
+	__m512i h = _mm512_maskz_loadu_epi64(0x3F, ctx->hash);
+	byte_t rnd = ctx->rnd;
+	size_t i;
+	for(i = 0U; i < len; ++i)
+	{
+		h = round_x1(h, data_in[i], rnd++);
+	}
+	_mm512_mask_storeu_epi64(ctx->hash, 0x3F, h);
+	ctx->rnd = rnd;
+}
+
+/*
+ * Compute the final hash value (AVX-512, single stream)
+ */
+static TARGET_AVX512 void final_avx512v(mhash384_t *const ctx, byte_t *const digest_out)
+{
+	__m512i h = _mm512_maskz_loadu_epi64(0x3F, ctx->hash);
+	ui64_t hash[8U];
+	ui16_t prev_value = 256U;
+	size_t i;
+	for(i = 0U; i < MHASH384_SIZE; ++i)
+	{
+		h = round_x1(h, prev_value, ctx->rnd++);
+		_mm512_storeu_si512(hash, h);
+		prev_value = digest_out[i] = get_byte(hash, MHASH384_FIN[i]);
+	}
+	_mm512_mask_storeu_epi64(ctx->hash, 0x3F, h);
+}
+
+#endif //MHASH384_DISPATCH
+
+/* ======================================================================== */
+/* KERNEL DISPATCH                                                          */
+/* ======================================================================== */
+
+/*
+ * Kernel descriptor; "rounds_x8" is NULL, if the batch function is faster with one message at a time
+ */
+typedef struct
+{
+	const char *name;
+	void (*update)   (mhash384_t *const ctx, const byte_t *const data_in, const size_t len);
+	void (*final)    (mhash384_t *const ctx, byte_t *const digest_out);
+	void (*update_x8)(mhash384_x8_t *const ctx, const byte_t *const *const data_in, const size_t len);
+	void (*final_x8) (mhash384_x8_t *const ctx, byte_t *const *const digest_out);
+	void (*rounds_x8)(mhash384_x8_t *const ctx, const byte_t *const *const data_in, byte_t *const *const digest_out, const byte_t (*const fin_idx)[MHASH384_LANES], ui16_t *const row, const byte_t fin_mask, const size_t n);
+}
+kernel_t;
+
+/*
+ * Available kernels, ordered by preference (lowest first)
+ */
+static const kernel_t MHASH384_KERNELS[] =
+{
+	{ "scalar",  update_generic, final_generic,  update_x8_generic, final_x8_generic, NULL              },
+#ifdef MHASH384_DISPATCH
+	{ "sse4.2",  update_sse42,   final_sse42,    update_x8_generic, final_x8_generic, NULL              },
+	{ "avx2",    update_avx2,    final_avx2,     update_x8_avx2,    final_x8_avx2,    NULL              },
+	{ "avx512v", update_avx512v, final_avx512v,  update_x8_avx512,  final_x8_avx512,  rounds_x8_avx512  },
+	{ "avx512",  update_avx512,  final_avx512,   update_x8_avx512,  final_x8_avx512,  rounds_x8_avx512  },
+#endif //MHASH384_DISPATCH
+};
+
+#define KERNEL_COUNT (sizeof(MHASH384_KERNELS) / sizeof(MHASH384_KERNELS[0U]))
+
+/*
+ * Check whether the CPU (and OS) supports the given kernel
+ */
+static int kernel_supported(const size_t idx)
+{
+#if defined(MHASH384_DISPATCH) && defined(_MSC_VER) && !defined(__clang__)
+	int info_1[4U], info_7[4U];
+	ui64_t xcr0 = 0U;
+	__cpuid(info_1, 1);
+	__cpuidex(info_7, 7, 0);
+	if(info_1[2U] & (1 << 27))
+	{
+		xcr0 = _xgetbv(0);
+	}
+	switch(idx)
+	{
+		case 0U: return 1;
+		case 1U: return (info_1[2U] & (1 << 20)) && (info_1[2U] & (1 << 23));
+		case 2U: return ((xcr0 & 0x06) == 0x06) && (info_7[1U] & (1 << 5));
+		case 3U:
+		case 4U: return ((xcr0 & 0xE6) == 0xE6) && (info_7[1U] & (1 << 16)) && (info_7[1U] & (1 << 17)) && (info_7[1U] & (1 << 5));
+	}
+	return 0;
+#elif defined(MHASH384_DISPATCH)
+	__builtin_cpu_init();
+	switch(idx)
+	{
+		case 0U: return 1;
+		case 1U: return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+		case 2U: return __builtin_cpu_supports("avx2");
+		case 3U:
+		case 4U: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+	}
+	return 0;
+#else
+	return (idx == 0U);
+#endif
+}
+
+/*
+ * Select the best kernel supported by the CPU, unless overridden by the "MHASH384_KERNEL" environment variable
+ */
+static const kernel_t *kernel_select(void)
+{
+	const char *const name = getenv("MHASH384_KERNEL");
+	size_t idx, best = 0U;
+	for(idx = 0U; idx < KERNEL_COUNT; ++idx)
+	{
+		if(kernel_supported(idx))
+		{
+			if(name && (!strcmp(name, MHASH384_KERNELS[idx].name)))
+			{
+				return &MHASH384_KERNELS[idx];
+			}
+			best = idx;
+		}
+	}
+	if(name && name[0U])
+	{
+		static bool warned = false;
+		if(!warned)
+		{
+			warned = true;
+			fprintf(stderr, "MHash384: Kernel \"%s\" is unknown or not supported by the CPU, using \"%s\" instead!\n", name, MHASH384_KERNELS[best].name);
+		}
+	}
+	return &MHASH384_KERNELS[best];
+}
+
+/*
+ * The kernel is selected once, at load time
+ */
+static const kernel_t *const g_kernel = kernel_select();
+
+static ALWAYS_INLINE const kernel_t *get_kernel(void)
+{
+	return g_kernel ? g_kernel : kernel_select(); /*called before static initialization?*/
+}
+
+/* ======================================================================== */
+/* BATCH PROCESSING                                                         */
+/* ======================================================================== */
+
+#define LANE_IDLE SIZE_MAX
+
+/*
+ * Per-lane state of the batch scheduler
+ */
+typedef struct
+{
+	size_t msg[MHASH384_LANES];       /*message currently assigned to the lane, or LANE_IDLE*/
+	const byte_t *ptr[MHASH384_LANES]; /*next input byte*/
+	size_t remaining[MHASH384_LANES]; /*input bytes left*/
+	size_t fin[MHASH384_LANES];       /*finalization rounds done, or LANE_IDLE while still updating*/
+	ui16_t row[MHASH384_LANES];       /*table row for the next finalization round*/
+}
+batch_t;
+
+/*
+ * Assign the next pending message to the given lane (or mark the lane as idle)
+ */
+static void batch_refill(batch_t *const batch, mhash384_x8_t *const ctx, const size_t lane, const byte_t *const *const data_in, const size_t *const len, const size_t count, size_t *const next)
+{
+	size_t j;
+	if(*next < count)
+	{
+		batch->msg[lane] = *next;
+		batch->ptr[lane] = data_in[*next];
+		batch->remaining[lane] = len[*next];
+		batch->fin[lane] = len[*next] ? LANE_IDLE : 0U;
+		batch->row[lane] = 256U;
+		ctx->rnd[lane] = 0U;
+		for(j = 0U; j < MHASH384_WORDS; ++j)
+		{
+			ctx->hash[j][lane] = MHASH384_INI[j];
+		}
+		++(*next);
+	}
+	else
+	{
+		batch->msg[lane] = LANE_IDLE;
+	}
+}
+
+/*
+ * Compute hash values of many messages, keeping all lanes busy: as soon as a lane has consumed its input, it runs
+ * its finalization rounds side by side with the other lanes, and then the next pending message takes over the lane
+ */
+static void compute_batch(const kernel_t *const kernel, byte_t (*const digests_out)[MHASH384_SIZE], const byte_t *const *const data_in, const size_t *const len, const size_t count)
+{
+	static const byte_t ZERO_INPUT[MHASH384_SIZE] = { 0U };
+	mhash384_x8_t ctx;
+	batch_t batch;
+	byte_t fin_idx[MHASH384_SIZE][MHASH384_LANES], scratch[MHASH384_SIZE];
+	const byte_t *input[MHASH384_LANES];
+	byte_t *output[MHASH384_LANES];
+	size_t i, lane, next = 0U, active = 0U;
+
+	for(lane = 0U; lane < MHASH384_LANES; ++lane)
+	{
+		batch_refill(&batch, &ctx, lane, data_in, len, count, &next);
+		active += (batch.msg[lane] != LANE_IDLE) ? 1U : 0U;
+	}
+
+	while(active > 0U)
+	{
+		const byte_t *some_ptr = ZERO_INPUT;
+		size_t span = SIZE_MAX;
+		byte_t fin_mask = 0U;
+		for(lane = 0U; lane < MHASH384_LANES; ++lane)
+		{
+			if(batch.msg[lane] != LANE_IDLE)
+			{
+				if(batch.fin[lane] != LANE_IDLE)
+				{
+					fin_mask |= (byte_t)(1U << lane);
+					if(MHASH384_SIZE - batch.fin[lane] < span)
+					{
+						span = MHASH384_SIZE - batch.fin[lane];
+					}
+				}
+				else if(batch.remaining[lane] < span)
+				{
+					span = batch.remaining[lane];
+					some_ptr = batch.ptr[lane];
+				}
+			}
+		}
+
+		if(!fin_mask)
+		{
+			/*all active lanes are updating: process the longest common span at once*/
+			for(lane = 0U; lane < MHASH384_LANES; ++lane)
+			{
+				input[lane] = (batch.msg[lane] != LANE_IDLE) ? batch.ptr[lane] : some_ptr;
+			}
+			kernel->update_x8(&ctx, input, span);
+		}
+		else
+		{
+			/*some lanes are finalizing: they feed back their digest bytes, while the other lanes keep updating*/
+			for(lane = 0U; lane < MHASH384_LANES; ++lane)
+			{
+				const int finalizing = (fin_mask >> lane) & 1U;
+				input[lane] = ((batch.msg[lane] != LANE_IDLE) && (!finalizing)) ? batch.ptr[lane] : ZERO_INPUT;
+				output[lane] = finalizing ? (digests_out[batch.msg[lane]] + batch.fin[lane]) : scratch;
+				for(i = 0U; i < span; ++i)
+				{
+					fin_idx[i][lane] = finalizing ? MHASH384_FIN[batch.fin[lane] + i] : 0U;
+				}
+			}
+			kernel->rounds_x8(&ctx, input, output, (const byte_t (*)[MHASH384_LANES])fin_idx, batch.row, fin_mask, span);
+		}
+
+		for(lane = 0U; lane < MHASH384_LANES; ++lane)
+		{
+			if(batch.msg[lane] != LANE_IDLE)
+			{
+				if(batch.fin[lane] == LANE_IDLE)
+				{
+					batch.ptr[lane] += span;
+					if(!(batch.remaining[lane] -= span))
+					{
+						batch.fin[lane] = 0U;
+						batch.row[lane] = 256U;
+					}
+				}
+				else if((batch.fin[lane] += span) >= MHASH384_SIZE)
+				{
+					batch_refill(&batch, &ctx, lane, data_in, len, count, &next);
+					active -= (batch.msg[lane] == LANE_IDLE) ? 1U : 0U;
+				}
+			}
+		}
+	}
+}
+
+/* ======================================================================== */
+/* TREE MODE                                                                */
+/* ======================================================================== */
+
+/*
+ * Domain separation prefixes for leaves, inner nodes and the root
+ */
+static const byte_t TREE_LEAF = 0x00;
+static const byte_t TREE_NODE = 0x01;
+static const byte_t TREE_ROOT = 0x02;
+
+/*
+ * Compute the digest of an inner node from the digests of its left and right children
+ */
+static void tree_node(byte_t *const digest_out, const byte_t *const left, const byte_t *const right)
+{
+	const kernel_t *const kernel = get_kernel();
+	mhash384_t ctx;
+	mhash384_init(&ctx);
+	kernel->update(&ctx, &TREE_NODE, 1U);
+	kernel->update(&ctx, left,  MHASH384_SIZE);
+	kernel->update(&ctx, right, MHASH384_SIZE);
+	kernel->final (&ctx, digest_out);
+}
+
+/* ======================================================================== */
+/* USAGE STATISTICS                                                         */
+/* ======================================================================== */
+
+#if MHASH384_STATS
+
+/* Counter indices */
+#define STAT_BYTES  0U
+#define STAT_UPDATE 1U
+#define STAT_FINAL  2U
+#define STAT_SIZES  3U
+#define STAT_COUNT  (STAT_SIZES + MHASH384_STATS_BUCKETS)
+
+/*
+ * Counters of a single thread; only the owning thread writes them, so plain relaxed loads and stores are sufficient
+ * (no read-modify-write), while other threads can still read them at any time
+ */
+typedef struct _stats_block_t
+{
+	std::atomic<ui64_t> value[STAT_COUNT];
+	struct _stats_block_t *prev, *next;
+}
+stats_block_t;
+
+/*
+ * All live blocks, plus the totals of the threads that have exited, plus the totals at the time of the last reset
+ */
+static std::mutex g_stats_mutex;
+static stats_block_t *g_stats_list = NULL;
+static ui64_t g_stats_retired[STAT_COUNT];
+static ui64_t g_stats_baseline[STAT_COUNT];
+
+/*
+ * Registers the block of the thread on first use, and retires it when the thread exits
+ */
+class stats_thread_t
+{
+public:
+	stats_thread_t(void)
+	{
+		size_t i;
+		for(i = 0U; i < STAT_COUNT; ++i)
+		{
+			m_block.value[i].store(0U, std::memory_order_relaxed);
+		}
+		std::lock_guard<std::mutex> lock(g_stats_mutex);
+		m_block.prev = NULL;
+		if((m_block.next = g_stats_list))
+		{
+			g_stats_list->prev = &m_block;
+		}
+		g_stats_list = &m_block;
+	}
+
+	~stats_thread_t(void)
+	{
+		size_t i;
+		std::lock_guard<std::mutex> lock(g_stats_mutex);
+		for(i = 0U; i < STAT_COUNT; ++i)
+		{
+			g_stats_retired[i] += m_block.value[i].load(std::memory_order_relaxed);
+		}
+		if(m_block.next)
+		{
+			m_block.next->prev = m_block.prev;
+		}
+		*(m_block.prev ? &m_block.prev->next : &g_stats_list) = m_block.next;
+	}
+
+	ALWAYS_INLINE void add(const size_t idx, const ui64_t value)
+	{
+		std::atomic<ui64_t> &counter = m_block.value[idx];
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+private:
+	stats_block_t m_block;
+};
+
+static thread_local stats_thread_t t_stats;
+
+/*
+ * Histogram bucket of the given update size, i.e. the number of significant bits
+ */
+static ALWAYS_INLINE size_t stats_bucket(size_t len)
+{
+	size_t bucket = 0U;
+	for(; len && (bucket < MHASH384_STATS_BUCKETS - 1U); len >>= 1)
+	{
+		++bucket;
+	}
+	return bucket;
+}
+
+static ALWAYS_INLINE void stats_update(const size_t calls, const ui64_t bytes, const size_t len)
+{
+	t_stats.add(STAT_BYTES, bytes);
+	t_stats.add(STAT_UPDATE, calls);
+	t_stats.add(STAT_SIZES + stats_bucket(len), calls);
+}
+
+/*
+ * Sum up the counters of all threads; the caller must hold the lock
+ */
+static void stats_totals(ui64_t *const totals)
+{
+	const stats_block_t *block;
+	size_t i;
+	memcpy(totals, g_stats_retired, sizeof(g_stats_retired));
+	for(block = g_stats_list; block; block = block->next)
+	{
+		for(i = 0U; i < STAT_COUNT; ++i)
+		{
+			totals[i] += block->value[i].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+#	define STATS_UPDATE(CALLS, BYTES, LEN) stats_update((CALLS), (BYTES), (LEN))
+#	define STATS_BYTES(BYTES) t_stats.add(STAT_BYTES, (BYTES))
+#	define STATS_FINAL(COUNT) t_stats.add(STAT_FINAL, (COUNT))
+#else
+#	define STATS_UPDATE(CALLS, BYTES, LEN) ((void)0)
+#	define STATS_BYTES(BYTES) ((void)0)
+#	define STATS_FINAL(COUNT) ((void)0)
+#endif //MHASH384_STATS
+
+/* ======================================================================== */
+/* PUBLIC FUNCTIONS                                                         */
+/* ======================================================================== */
+
+/*
+ * Initialize hash computation
+ */
+void mhash384_init(mhash384_t *const ctx)
+{
+	ctx->rnd = 0U;
+	memcpy(ctx->hash, MHASH384_INI, MHASH384_SIZE);
+}
+
+/*
+ * Process next block of input data
+ */
+void mhash384_update(mhash384_t *const ctx, const byte_t *const data_in, const size_t len)
+{
+	STATS_UPDATE(1U, len, len);
+	get_kernel()->update(ctx, data_in, len);
+}
+
+/*
+ * Compute the final hash value
+ */
+void mhash384_final(mhash384_t *const ctx, byte_t *const digest_out)
+{
+	STATS_FINAL(1U);
+	get_kernel()->final(ctx, digest_out);
+}
+
+/*
+ * Get hash value for given input at once
+ */
+void mhash384_compute(byte_t *const digest_out, const byte_t *const data_in, const size_t len)
+{
+	mhash384_t ctx; /*transient ctx*/
+	mhash384_init  (&ctx);
+	mhash384_update(&ctx, data_in, len);
+	mhash384_final (&ctx, digest_out);
+}
+
+/*
+ * Initialize multi-buffer hash computation
+ */
+void mhash384_init_x8(mhash384_x8_t *const ctx)
+{
+	size_t j, lane;
+	for(lane = 0U; lane < MHASH384_LANES; ++lane)
+	{
+		ctx->rnd[lane] = 0U;
+		for(j = 0U; j < MHASH384_WORDS; ++j)
+		{
+			ctx->hash[j][lane] = MHASH384_INI[j];
+		}
+	}
+}
+
+/*
+ * Process next block of input data on all lanes; each lane consumes "len" bytes from its own input
+ */
+void mhash384_update_x8(mhash384_x8_t *const ctx, const byte_t *const *const data_in, const size_t len)
+{
+	STATS_UPDATE(1U, (ui64_t)len * MHASH384_LANES, len);
+	get_kernel()->update_x8(ctx, data_in, len);
+}
+
+/*
+ * Compute the final hash values of all lanes
+ */
+void mhash384_final_x8(mhash384_x8_t *const ctx, byte_t *const *const digest_out)
+{
+	STATS_FINAL(MHASH384_LANES);
+	get_kernel()->final_x8(ctx, digest_out);
+}
+
+/*
+ * Get hash values for many messages at once
+ */
+void mhash384_compute_batch(byte_t (*const digests_out)[MHASH384_SIZE], const byte_t *const *const data_in, const size_t *const len, const size_t count)
+{
+	const kernel_t *const kernel = get_kernel();
+	if(kernel->rounds_x8)
+	{
+#if MHASH384_STATS
+		size_t i;
+		for(i = 0U; i < count; ++i)
+		{
+			STATS_BYTES(len[i]);
+		}
+		STATS_FINAL(count);
+#endif //MHASH384_STATS
+		compute_batch(kernel, digests_out, data_in, len, count);
+	}
+	else
+	{
+		size_t i;
+		for(i = 0U; i < count; ++i)
+		{
+			mhash384_compute(digests_out[i], data_in[i], len[i]);
+		}
+	}
+}
+
+/*
+ * Initialize tree hash computation
+ */
+void mhash384_tree_init(mhash384_tree_t *const ctx)
+{
+	ctx->leaf_count = 0U;
+	ctx->total_len = 0U;
+}
+
+/*
+ * Compute the digest of a single leaf; leaves are independent of each other and can be hashed on any thread
+ */
+void mhash384_tree_leaf(byte_t *const digest_out, const byte_t *const data_in, const size_t len)
+{
+	const kernel_t *const kernel = get_kernel();
+	mhash384_t ctx;
+	mhash384_init(&ctx);
+	STATS_BYTES(len);
+	STATS_FINAL(1U);
+	kernel->update(&ctx, &TREE_LEAF, 1U);
+	kernel->update(&ctx, data_in, len);
+	kernel->final (&ctx, digest_out);
+}
+
+/*
+ * Append the digest of the next leaf; complete sub-trees are merged right away, so that the stack holds at most one
+ * sub-tree per level, ordered from the largest (bottom) to the smallest (top)
+ */
+void mhash384_tree_append(mhash384_tree_t *const ctx, const byte_t *const leaf_digest, const size_t leaf_len)
+{
+	size_t top = 0U;
+	ui64_t count;
+	for(count = ctx->leaf_count; count; count &= count - 1U)
+	{
+		++top; /*stack height is the number of bits set*/
+	}
+	memcpy(ctx->stack[top], leaf_digest, MHASH384_SIZE);
+	for(count = ++ctx->leaf_count; !(count & 1U); count >>= 1U, --top)
+	{
+		tree_node(ctx->stack[top - 1U], ctx->stack[top - 1U], ctx->stack[top]);
+	}
+	ctx->total_len += leaf_len;
+}
+
+/*
+ * Compute the root digest; the remaining sub-trees are merged from the top of the stack downwards, and the root is
+ * bound to the total length of the input
+ */
+void mhash384_tree_final(mhash384_tree_t *const ctx, byte_t *const digest_out)
+{
+	const kernel_t *const kernel = get_kernel();
+	byte_t length[sizeof(ui64_t)];
+	mhash384_t root;
+	size_t top = 0U, i;
+	ui64_t count;
+
+	if(!ctx->leaf_count)
+	{
+		byte_t leaf_digest[MHASH384_SIZE];
+		mhash384_tree_leaf(leaf_digest, NULL, 0U); /*empty input has a single empty leaf*/
+		mhash384_tree_append(ctx, leaf_digest, 0U);
+	}
+	for(count = ctx->leaf_count; count; count &= count - 1U)
+	{
+		++top;
+	}
+	for(--top; top > 0U; --top)
+	{
+		tree_node(ctx->stack[top - 1U], ctx->stack[top - 1U], ctx->stack[top]);
+	}
+
+	for(i = 0U; i < sizeof(ui64_t); ++i)
+	{
+		length[i] = (byte_t)(ctx->total_len >> (8U * i));
+	}
+	mhash384_init(&root);
+	kernel->update(&root, &TREE_ROOT, 1U);
+	kernel->update(&root, ctx->stack[0U], MHASH384_SIZE);
+	kernel->update(&root, length, sizeof(ui64_t));
+	kernel->final (&root, digest_out);
+}
+
+/*
+ * Get tree hash value for given input at once (on the calling thread)
+ */
+void mhash384_tree_compute(byte_t *const digest_out, const byte_t *const data_in, const size_t len)
+{
+	mhash384_tree_t ctx; /*transient ctx*/
+	byte_t leaf_digest[MHASH384_SIZE];
+	size_t offset = 0U;
+	mhash384_tree_init(&ctx);
+	do
+	{
+		const size_t leaf_len = ((len - offset) < MHASH384_TREE_LEAF_SIZE) ? (len - offset) : MHASH384_TREE_LEAF_SIZE;
+		mhash384_tree_leaf(leaf_digest, data_in + offset, leaf_len);
+		mhash384_tree_append(&ctx, leaf_digest, leaf_len);
+		offset += leaf_len;
+	}
+	while(offset < len);
+	mhash384_tree_final(&ctx, digest_out);
+}
+
+/*
+ * Query the usage statistics, accumulated over all threads since the last reset
+ */
+int mhash384_stats_get(mhash384_stats_t *const stats)
+{
+	memset(stats, 0, sizeof(mhash384_stats_t));
+#if MHASH384_STATS
+	{
+		ui64_t totals[STAT_COUNT];
+		size_t i;
+		{
+			std::lock_guard<std::mutex> lock(g_stats_mutex);
+			stats_totals(totals);
+			for(i = 0U; i < STAT_COUNT; ++i)
+			{
+				totals[i] -= g_stats_baseline[i];
+			}
+		}
+		stats->bytes = totals[STAT_BYTES];
+		stats->update_calls = totals[STAT_UPDATE];
+		stats->final_calls = totals[STAT_FINAL];
+		for(i = 0U; i < MHASH384_STATS_BUCKETS; ++i)
+		{
+			stats->update_sizes[i] = totals[STAT_SIZES + i];
+		}
+		return 1;
+	}
+#else
+	return 0;
+#endif //MHASH384_STATS
+}
+
+/*
+ * Reset the usage statistics
+ */
+void mhash384_stats_reset(void)
+{
+#if MHASH384_STATS
+	std::lock_guard<std::mutex> lock(g_stats_mutex);
+	stats_totals(g_stats_baseline);
+#endif //MHASH384_STATS
+}
+
+/*
+ * Query the name of the active kernel
+ */
+const char *mhash384_kernel(void)
+{
+	return get_kernel()->name;
 }
 
 /*
@@ -1025,8 +2443,8 @@ int mhash384_selftest(void)
 		{
 			if(i != j)
 			{
-				const ui32_t distance_xor = hamming_distance(MHASH384_XOR[i], MHASH384_XOR[j]);
-				const ui32_t distance_add = hamming_distance(MHASH384_ADD[i], MHASH384_ADD[j]);
+				const ui32_t distance_xor = hamming_distance(TABLE_XOR(i), TABLE_XOR(j));
+				const ui32_t distance_add = hamming_distance(TABLE_ADD(i), TABLE_ADD(j));
 				min_distance = minimum3(min_distance, distance_xor, distance_add);
 			}
 		}